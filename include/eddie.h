@@ -38,29 +38,63 @@
 //#include <stdio.h>
 //#include <unistd.h>
 #include <ros/ros.h>
-#include <fcntl.h>
-#include <termios.h>
-#include <semaphore.h>
+#include <ros/callback_queue.h>
 #include <string>
 #include <sstream>
 #include <map>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "eddie_pid.h"
+#include "eddie_pursuit.h"
+#include "eddie_odometry.h"
+#include "eddie_realtime.h"
+#include "eddie_processing.h"
+#include "eddie_shm.h"
+#include "eddie_telemetry.h"
+#include "eddie_rtt.h"
+#include "eddie_log.h"
+#include "eddie_history.h"
+#include "eddie_commands.h"
+#include "eddie_io.h"
 #include <parallax_eddie_robot/Ping.h>
 #include <parallax_eddie_robot/ADC.h>
+#include <parallax_eddie_robot/MotionPrimitive.h>
+#include <parallax_eddie_robot/MotionSequenceFeedback.h>
+#include <parallax_eddie_robot/PathFeedback.h>
+#include <parallax_eddie_robot/ReflexStop.h>
+#include <parallax_eddie_robot/SensorFrame.h>
+#include <parallax_eddie_robot/TraceEvent.h>
+#include <parallax_eddie_robot/WheelOdometry.h>
 #include <parallax_eddie_robot/Accelerate.h>
+#include <parallax_eddie_robot/CancelMotionSequence.h>
+#include <parallax_eddie_robot/DriveClosedLoop.h>
 #include <parallax_eddie_robot/DriveWithDistance.h>
 #include <parallax_eddie_robot/DriveWithPower.h>
 #include <parallax_eddie_robot/DriveWithSpeed.h>
+#include <parallax_eddie_robot/ExecuteBatch.h>
+#include <parallax_eddie_robot/ExecuteMotionSequence.h>
+#include <parallax_eddie_robot/FollowPath.h>
 #include <parallax_eddie_robot/GetDistance.h>
+#include <parallax_eddie_robot/GetGpioState.h>
 #include <parallax_eddie_robot/GetHeading.h>
 #include <parallax_eddie_robot/GetSpeed.h>
+#include <parallax_eddie_robot/GetStateAt.h>
 #include <parallax_eddie_robot/ResetEncoder.h>
 #include <parallax_eddie_robot/Rotate.h>
+#include <parallax_eddie_robot/SetGpioDirection.h>
+#include <parallax_eddie_robot/SetGpioState.h>
+#include <parallax_eddie_robot/SetRelays.h>
 #include <parallax_eddie_robot/StopAtDistance.h>
 #include <parallax_eddie_robot/DriveWithDistance.h>
 
 class Eddie {
 public:
-    Eddie();
+    //Serves one board on io. Services are advertised through node_handle and
+    //topics under topic_namespace, so several boards can share one process.
+    //Services are served from callback_queue if given, spun by the caller,
+    //otherwise from the board's own queue and service_threads spinner threads.
+    Eddie(EddieIO &io, ros::NodeHandle node_handle = ros::NodeHandle(), std::string topic_namespace = "/eddie",
+          ros::CallbackQueue* callback_queue = NULL);
     virtual ~Eddie();
 
     //==============================================//
@@ -122,12 +156,6 @@ public:
     //12v Solid State Relay is located on GPIO pin 13: 18
     const unsigned char RELAY_12V_PIN_NUMBER;
 
-    //Packet terminator as byte: '\r'
-    const unsigned char PACKET_TERMINATOR;
-
-    //Parameter delimiter, a space character: ' '
-    const unsigned char PARAMETER_DELIMITER;
-
     //Response from FW in the case of a problem: "ERROR"
     const std::string ERROR;
 
@@ -137,120 +165,322 @@ public:
     //Default ticks per revolution: 36
     const int DEFAULT_TICKS_PER_REVOLUTION;
 
-    //=====================================================//
-    //PARALLAX EDDIE CONTROL BOARD FIRMWARE COMMAND STRINGS//
-    //=====================================================//
-
-    //Returns 16 bits representing the Firmware version: "VER"
-    const std::string GET_VERSION_STRING;
-
-    //Sets specific GPIO pins to output using a 20 bit mask: "OUT"
-    const std::string SET_GPIO_DIRECTION_OUT_STRING;
-
-    //Sets specific GPIO pins to input using a 20 bit mask: "IN"
-    const std::string SET_GPIO_DIRECTION_IN_STRING;
-
-    //Sets specific GPIO output pins to high using a 20 bit mask: "HIGH"
-    const std::string SET_GPIO_STATE_HIGH_STRING;
-
-    //Sets specific GPIO output pins to low using a 20 bit mask: "LOW"
-    const std::string SET_GPIO_STATE_LOW_STRING;
-
-    //Return 20 bits representing a high/low state of all GPIO pins: "READ"
-    const std::string GET_GPIO_STATE_STRING;
-
-    //Return the ADC values as 8 separate 12 bits words: "ADC"
-    const std::string GET_ADC_VALUE_STRING;
-
-    //Return the digital PING values as 10|N separate 16 bits words: "PING"
-    const std::string GET_PING_VALUE_STRING;
-
-    //Sets drive power using 8 bits (signed) for each wheel -128|-127 is full reverse, 127 is full forward: "GO"
-    const std::string SET_DRIVE_POWER_STRING;
-
-    //Sets drive speed using 16 bits (signed) for each wheel, ? full reverse, ? full forward: "GOSPD"
-    const std::string SET_DRIVE_SPEED_STRING;
-
-    //Sets drive distance and speed using 16 bits (signed) value each, respectively: "TRVL"
-    const std::string SET_DRIVE_DISTANCE_STRING;
-
-    //Sets a gradual slow down to stop distance using 16 bits: "STOP"
-    const std::string SET_STOP_DISTANCE_STRING;
-
-    //Sends a rotate in place degrees and speed using 16 bits and 16 bits, respectively: "TURN"
-    const std::string SET_ROTATE_STRING;
-
-    //Returns the current speed at 8 bits: "SPD"
-    const std::string GET_CURRENT_SPEED_STRING;
-
-    //Returns the current heading, relative to start or last resetted, as 16 bits: "HEAD"
-    const std::string GET_CURRENT_HEADING_STRING;
-
-    //Returns the left and right encoder ticks as a pair of signed 16 bits: "DIST"
-    const std::string GET_ENCODER_TICKS_STRING;
-
-    //Zeros out the internal registers where encoder ticks are accumulated: "RST"
-    const std::string RESET_ENCODER_TICKS_STRING;
-
-    //Sets a velocity ramping value for drive system: "ACC"
-    const std::string SET_RAMPING_VALUE_STRING;
-
-    //Sends a full stop: "STOP 00"
-    //const std::string SET_FULL_STOP_STRING;
-
-    //Send a series of 3 carriage returns to reset the FW serial buffer: "\r\r\r"
-    const std::string FLUSH_BUFFERS_STRING;
+    //Serial link to the control board runs at 115200 baud, 8N1 (10 bits per byte)
+    const int SERIAL_BAUD_RATE;
 
     parallax_eddie_robot::Ping getPingData();
     parallax_eddie_robot::ADC getADCData();
 
-    void publishPingData();
-    void publishADCData();
+    parallax_eddie_robot::Ping publishPingData();
+    parallax_eddie_robot::ADC publishADCData();
 
-private:
-    sem_t mutex;
-    struct termios tio;
-    int tty_fd;
+    //Encoder ticks, heading and wheel speeds at any instant in the history
+    //window, interpolated from the samples the driver has taken. Does not
+    //touch the serial link and takes no lock, safe from any thread.
+    bool getStateAt(ros::Time stamp, parallax_eddie_robot::GetStateAt::Response &state) const;
 
+private:
+    //Serial mutex, taken by the real-time loops and the service threads alike
+    eddie_realtime::PriorityMutex mutex;
+    EddieIO &io_;
+    int channel_;
+    std::string topic_namespace_;
+
+    //Each board polls its sensors on its own thread, so a slow board does not
+    //hold up the others. A single board serves its services from its own queue
+    //and spinner; in a fleet the boards share one queue and spinner, handlers
+    //only waiting on their board's serial engine for a bounded time.
     ros::NodeHandle node_handle_;
+    ros::CallbackQueue callback_queue_;
+    boost::scoped_ptr<ros::AsyncSpinner> spinner_;
+    int service_threads_;
+    boost::thread poll_thread_;
+    double poll_rate_;
+
+    //Adaptive polling, the poll loop drops to poll_idle_rate once no drive
+    //command has been sent and the wheels have been still for
+    //poll_idle_delay, and goes back to poll_rate on the next drive command.
+    //Time in each mode is reported every poll_mode_report_period.
+    struct PollModes
+    {
+      double seconds[2];
+      uint64_t cycles[2];
+      uint64_t transitions;
+    };
+    double poll_idle_rate_, poll_idle_delay_, poll_mode_report_period_;
+    boost::mutex poll_mutex_;
+    boost::condition_variable poll_condition_;
+    ros::WallTime last_drive_command_;
+    bool poll_woken_;
+    PollModes poll_modes_;
+
+    //Process wide real-time settings, read from the global realtime_* parameters
+    eddie_realtime::Config realtime_;
     ros::Publisher ping_pub_;
     ros::Publisher adc_pub_;
+    ros::Publisher motion_feedback_pub_;
+    ros::Publisher path_feedback_pub_;
+    ros::Publisher reflex_pub_;
+    ros::Publisher trace_pub_;
+    ros::Publisher telemetry_pub_;
+    ros::Publisher sensor_frame_pub_;
     ros::ServiceServer accelerate_srv_;
+    ros::ServiceServer cancel_motion_sequence_srv_;
+    ros::ServiceServer drive_closed_loop_srv_;
     ros::ServiceServer drive_with_distance_srv_;
     ros::ServiceServer drive_with_power_srv_;
     ros::ServiceServer drive_with_speed_srv_;
+    ros::ServiceServer execute_batch_srv_;
+    ros::ServiceServer execute_motion_sequence_srv_;
+    ros::ServiceServer follow_path_srv_;
     ros::ServiceServer get_distance_srv_;
+    ros::ServiceServer get_gpio_state_srv_;
     ros::ServiceServer get_heading_srv_;
     ros::ServiceServer get_speed_srv_;
+    ros::ServiceServer get_state_at_srv_;
     ros::ServiceServer reset_encoder_srv_;
     ros::ServiceServer rotate_srv_;
+    ros::ServiceServer set_gpio_direction_srv_;
+    ros::ServiceServer set_gpio_state_srv_;
+    ros::ServiceServer set_relays_srv_;
     ros::ServiceServer stop_at_distance_srv_;
 
+    //Closed-loop wheel speed control, runs on its own thread at speed_loop_rate_
+    boost::thread speed_loop_thread_;
+    boost::mutex speed_loop_mutex_;
+    //Signalled when the loop is engaged, it sleeps on it while disengaged
+    boost::condition_variable speed_loop_condition_;
+    bool speed_loop_engaged_;
+    bool encoder_reset_pending_;
+    int16_t target_left_speed_, target_right_speed_;
+    double speed_loop_rate_;
+    double speed_loop_filter_;
+    EddiePID left_pid_, right_pid_;
+    parallax_eddie_robot::Trace speed_loop_trace_;
+
+    //Path following, run by the speed loop while a path is active. The pose is
+    //integrated from the encoder ticks and gyro heading the loop samples each
+    //cycle, and the pursuit tracker turns it into the wheel speed targets. A
+    //path that makes no progress for path_stall_cycles cycles is aborted as
+    //STALLED. Guarded by speed_loop_mutex_.
+    EddiePursuit pursuit_;
+    EddieOdometry path_odometry_;
+    bool path_active_;
+    uint32_t path_id_;
+    size_t path_size_;
+    double wheel_radius_, wheel_base_;
+    int ticks_per_revolution_;
+    double path_max_speed_, path_feedback_rate_;
+    ros::WallTime path_feedback_time_;
+    int path_stall_cycles_, path_stall_count_;
+    double path_best_progress_, path_stall_theta_;
+
+    //Motion sequence execution, completion is tracked on its own thread by
+    //polling encoder ticks and heading at motion_poll_rate_
+    boost::thread motion_thread_;
+    boost::mutex motion_mutex_;
+    boost::condition_variable motion_condition_;
+    std::vector<parallax_eddie_robot::MotionPrimitive> motion_sequence_;
+    uint32_t motion_sequence_id_;
+    bool motion_active_, motion_started_, motion_moved_;
+    size_t motion_index_;
+    int motion_settle_count_;
+    int32_t motion_start_left_, motion_start_right_, motion_last_left_, motion_last_right_;
+    int motion_last_heading_, motion_turned_;
+    float motion_progress_;
+    ros::WallTime motion_start_time_;
+    double motion_poll_rate_, motion_stall_timeout_;
+    int motion_tick_tolerance_, motion_heading_tolerance_, motion_settle_cycles_;
+
+    //Reflex stop on freshly parsed ping frames, guarded by the serial mutex.
+    //reflex_blocked_ holds while any sensor with a threshold reads below it;
+    //forward drives are refused and STOP is sent again on every ping until it
+    //clears. It is read without the mutex to refuse drives before queuing.
+    bool reflex_enabled_;
+    bool reflex_tripped_;
+    volatile bool reflex_blocked_;
+    std::vector<int> reflex_thresholds_;
+    std::vector<bool> reflex_armed_;
+    //Whether the last drive command written moves the robot forward
+    bool drive_forward_;
+
+    //Shadow copies of the GPIO direction and output registers. Only bits that
+    //differ from the shadow (or were never written) are sent, so a batch of
+    //pin changes costs one OUT/IN/HIGH/LOW command per direction of change
+    boost::mutex gpio_mutex_;
+    uint32_t gpio_direction_, gpio_direction_known_;
+    uint32_t gpio_output_, gpio_output_known_;
+    uint32_t gpio_input_;
+    ros::Time gpio_input_stamp_;
+    double gpio_cache_max_age_;
+
+    //Response timeouts adapt to the measured round trip of each opcode. A
+    //command that times out resynchronizes the link with FLUSH_BUFFERS and,
+    //if repeatable, is retried with a bounded exponential backoff. All of
+    //this runs under the serial mutex.
+    struct LinkStats
+    {
+      uint64_t commands, timeouts, retries, recoveries, failures;
+      double last_recovery, max_recovery, total_recovery;
+    };
+    std::map<const char*, EddieRTT> rtt_;
+    double serial_initial_timeout_, serial_min_timeout_, serial_max_timeout_;
+    int serial_retries_;
+    double serial_retry_backoff_, serial_retry_backoff_max_, serial_resync_settle_;
+    LinkStats link_stats_;
+
+    //Serial engine. command() queues its frame for the engine thread and
+    //sleeps until the response is in, so service threads wait on a condition
+    //rather than on the serial mutex. Each pass takes everything queued under
+    //one hold of the mutex: identical queries queued together are sent once
+    //and share the response, and the rest are pipelined with
+    //serial_pipelining, so concurrent callers share round trips.
+    struct Submission
+    {
+      const eddie_commands::Frame *frame;
+      std::string response;
+      ros::Time written, sampled;
+      Submission *same;
+      bool done;
+    };
+    struct EngineStats
+    {
+      uint64_t submissions, coalesced, passes, pipelined;
+      size_t largest_pass;
+    };
+    boost::thread engine_thread_;
+    boost::mutex engine_mutex_;
+    boost::condition_variable engine_condition_, engine_done_;
+    std::vector<Submission*> engine_queue_;
+    bool engine_running_;
+    bool serial_pipelining_;
+    EngineStats engine_stats_;
+    //execute_batch holds the serial mutex for the whole batch, keeping the
+    //loops and the reflex ping off the link, so batches are capped
+    int max_batch_size_;
+
+    //Stage timestamps for traced drive commands are published when enabled
+    bool trace_enabled_;
+
+    //Columnar telemetry log, enabled by telemetry_log_directory
+    boost::scoped_ptr<eddie_log::Writer> telemetry_log_;
+
+    //Compact telemetry for remote monitoring, one frame per poll cycle when
+    //telemetry_enabled, with its compression reported every
+    //telemetry_report_period
+    boost::scoped_ptr<eddie_telemetry::Encoder> telemetry_encoder_;
+    double telemetry_report_period_;
+
+    //Ping filtering, IR, battery and odometry on each poll cycle's frame,
+    //run in parallel on processing_threads workers with processing_enabled
+    boost::scoped_ptr<EddieProcessing> processing_;
+
+    //With sensor_frame_enabled every poll cycle queues all of its queries in
+    //one pass of the serial engine and publishes them together as a
+    //SensorFrame. sensor_topics_enabled keeps ping_data and adc_data going
+    //for consumers of the separate topics.
+    bool sensor_frame_enabled_;
+    bool sensor_topics_enabled_;
+
+    //Newest sensor frame in shared memory for local consumers, with shm_enabled
+    boost::scoped_ptr<eddie_shm::Writer> shm_;
+
+    //Time-indexed history of every encoder, heading and speed sample taken,
+    //history_capacity samples each, off by default with a capacity of 0
+    boost::scoped_ptr<EddieHistory> encoder_history_, heading_history_, speed_history_;
+    double history_max_extrapolation_;
+
+    //With poll_odometry the poll thread also samples encoders, heading and
+    //wheel speeds while the log or history is enabled, so that they are
+    //recorded while no motion is running
+    bool poll_odometry_;
+
     void initialize(std::string port);
-    std::string command(std::string str);
-    std::string intToHexString(int num);
-    std::string generateCommand(std::string str1);
-    std::string generateCommand(std::string str1, int num1);
-    std::string generateCommand(std::string str1, int num1, int num2);
+    void pollLoop();
+    void noteDriveCommand();
+    void reportPollModes();
+    std::string command(const eddie_commands::Frame &frame, ros::Time *written_time = NULL, ros::Time *sampled_time = NULL);
+    void commandAll(std::vector<Submission> &submissions);
+    void engineLoop();
+    size_t runPass(std::vector<Submission*> &pass);
+    std::string driveCommand(const eddie_commands::Frame &frame, ros::Time *written_time = NULL);
+    std::string transact(const eddie_commands::Frame &frame, ros::Time *written_time = NULL, ros::Time *sampled_time = NULL);
+    EddieRTT& opcodeRTT(const char* opcode);
+    ros::Time estimateSampleTime(size_t command_size, ros::Time written, size_t response_size, ros::Time received);
+    std::string tracedCommand(const eddie_commands::Frame &frame, const parallax_eddie_robot::Trace &trace);
+    void traceEvent(const parallax_eddie_robot::Trace &trace, uint8_t stage, ros::Time stamp);
+    parallax_eddie_robot::Ping parsePingData(std::string result, ros::Time stamp);
+    parallax_eddie_robot::ADC parseADCData(std::string result, ros::Time stamp);
+    void sendPingData(const parallax_eddie_robot::Ping &ping_data);
+    void sendADCData(const parallax_eddie_robot::ADC &adc_data);
+    void recordPingData(const parallax_eddie_robot::Ping &ping_data);
+    bool checkReflex(const parallax_eddie_robot::Ping &ping_data, parallax_eddie_robot::ReflexStop &reflex);
+    bool reflexBlocks(const eddie_commands::Frame &frame) const;
+    bool getEncoderTicks(int32_t &left, int32_t &right, ros::Time *stamp = NULL);
+    bool getEncoderTicksAndHeading(int32_t &left, int32_t &right, ros::Time *stamp, bool &has_heading,
+            uint16_t &heading);
+    bool getHeadingDegrees(uint16_t &heading, ros::Time *stamp = NULL);
+    bool getWheelSpeeds(int16_t &left, int16_t &right, ros::Time *stamp = NULL);
+    bool recordEncoderTicks(const std::string &response, ros::Time sampled, int32_t &left, int32_t &right);
+    bool recordHeadingDegrees(const std::string &response, ros::Time sampled, uint16_t &heading);
+    bool recordWheelSpeeds(const std::string &response, ros::Time sampled, int16_t &left, int16_t &right);
+    void sampleSensors(bool odometry, eddie_telemetry::Frame &frame, parallax_eddie_robot::Ping &ping_data,
+            parallax_eddie_robot::ADC &adc_data, parallax_eddie_robot::SensorFrame &sensors);
+    void logSample(eddie_log::Stream stream, ros::Time stamp, const int32_t* values, int count);
+    void logSample(eddie_log::Stream stream, ros::Time stamp, const std::vector<uint16_t> &values);
+    void speedLoop();
+    void disengageSpeedLoop();
+    bool trackPath(int32_t left_ticks, int32_t right_ticks, bool has_heading, uint16_t heading);
+    void publishPathFeedback(std::string status);
+    void finishPath(std::string status);
+    void motionLoop();
+    bool startMotionPrimitive();
+    bool pollMotionPrimitive(bool &done);
+    void publishMotionFeedback(std::string status);
+    void finishMotionSequence(std::string status);
+    void preemptMotionSequence();
+    void releaseDrive();
+    bool applyGpioDirection(uint32_t mask, uint32_t output);
+    bool applyGpioState(uint32_t mask, uint32_t state);
 
     bool accelerate(parallax_eddie_robot::Accelerate::Request &req,
             parallax_eddie_robot::Accelerate::Response &res);
+    bool cancelMotionSequence(parallax_eddie_robot::CancelMotionSequence::Request &req,
+            parallax_eddie_robot::CancelMotionSequence::Response &res);
+    bool driveClosedLoop(parallax_eddie_robot::DriveClosedLoop::Request &req,
+            parallax_eddie_robot::DriveClosedLoop::Response &res);
     bool driveWithDistance(parallax_eddie_robot::DriveWithDistance::Request &req,
             parallax_eddie_robot::DriveWithDistance::Response &res);
     bool driveWithPower(parallax_eddie_robot::DriveWithPower::Request &req,
             parallax_eddie_robot::DriveWithPower::Response &res);
     bool driveWithSpeed(parallax_eddie_robot::DriveWithSpeed::Request &req,
             parallax_eddie_robot::DriveWithSpeed::Response &res);
+    bool executeBatch(parallax_eddie_robot::ExecuteBatch::Request &req,
+            parallax_eddie_robot::ExecuteBatch::Response &res);
+    bool executeMotionSequence(parallax_eddie_robot::ExecuteMotionSequence::Request &req,
+            parallax_eddie_robot::ExecuteMotionSequence::Response &res);
+    bool followPath(parallax_eddie_robot::FollowPath::Request &req,
+            parallax_eddie_robot::FollowPath::Response &res);
     bool getDistance(parallax_eddie_robot::GetDistance::Request &req,
             parallax_eddie_robot::GetDistance::Response &res);
+    bool getGpioState(parallax_eddie_robot::GetGpioState::Request &req,
+            parallax_eddie_robot::GetGpioState::Response &res);
     bool getHeading(parallax_eddie_robot::GetHeading::Request &req,
             parallax_eddie_robot::GetHeading::Response &res);
     bool GetSpeed(parallax_eddie_robot::GetSpeed::Request &req,
             parallax_eddie_robot::GetSpeed::Response &res);
+    bool getStateAtService(parallax_eddie_robot::GetStateAt::Request &req,
+            parallax_eddie_robot::GetStateAt::Response &res);
     bool resetEncoder(parallax_eddie_robot::ResetEncoder::Request &req,
             parallax_eddie_robot::ResetEncoder::Response &res);
     bool rotate(parallax_eddie_robot::Rotate::Request &req,
             parallax_eddie_robot::Rotate::Response &res);
+    bool setGpioDirection(parallax_eddie_robot::SetGpioDirection::Request &req,
+            parallax_eddie_robot::SetGpioDirection::Response &res);
+    bool setGpioState(parallax_eddie_robot::SetGpioState::Request &req,
+            parallax_eddie_robot::SetGpioState::Response &res);
+    bool setRelays(parallax_eddie_robot::SetRelays::Request &req,
+            parallax_eddie_robot::SetRelays::Response &res);
     bool stopAtDistance(parallax_eddie_robot::StopAtDistance::Request &req,
             parallax_eddie_robot::StopAtDistance::Response &res);
 };
@@ -0,0 +1,76 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_CALIBRATE_H
+#define	_EDDIE_CALIBRATE_H
+
+#include <ros/ros.h>
+#include <string>
+#include "eddie_motor_table.h"
+
+//==============================================================================//
+// Motor calibration for the eddie driver. Drives both wheels at each GO power  //
+// from calibration_power_step up to calibration_max_power, forward and then in //
+// reverse so that the robot ends up about where it started, and measures each  //
+// wheel's speed from two DIST readings calibration_measure seconds apart, once //
+// it has had calibration_settle seconds to get up to speed. The table goes to  //
+// calibration_file, for eddie_controller to load as its motor_calibration_file.//
+// The robot needs a clear run of a few meters, or its wheels off the ground.   //
+// Ctrl-C stops the wheels before the node exits, without writing the table.    //
+//==============================================================================//
+
+class EddieCalibrate
+{
+public:
+  EddieCalibrate();
+
+  //Sweeps the power levels and saves the table, false if it could not
+  bool run();
+
+private:
+  ros::NodeHandle node_handle_;
+  ros::ServiceClient drive_power_;
+  ros::ServiceClient get_distance_;
+  int power_step_, max_power_;
+  double settle_, measure_;
+  std::string file_;
+  EddieMotorTable table_;
+
+  bool drive(int power);
+  bool measure(int power);
+  bool running() const;
+  bool wait(double seconds);
+};
+
+#endif	/* _EDDIE_CALIBRATE_H */
@@ -0,0 +1,589 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_COMMANDS_H
+#define	_EDDIE_COMMANDS_H
+
+#include <stdint.h>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <boost/static_assert.hpp>
+
+//==============================================================================//
+// Parallax Eddie control board firmware command table.                         //
+// Each opcode is a type describing its argument fields and response layout,   //
+// and encode<>() / decode<>() are instantiated from it at compile time. Using  //
+// a command with the wrong number of arguments or the wrong result array does  //
+// not compile, and offsets into the response are derived from the layout.     //
+// Adding a firmware command only takes a new entry below.                     //
+//==============================================================================//
+
+namespace eddie_commands
+{
+
+//Hexadecimal field of WIDTH digits, two's complement over WIDTH digits if SIGNED
+template <int Width, bool Signed>
+struct Hex
+{
+  enum { WIDTH = Width, SIGNED = Signed };
+};
+
+struct NoField
+{
+  enum { WIDTH = 0, SIGNED = 0 };
+};
+
+template <class A1 = NoField, class A2 = NoField>
+struct Arguments
+{
+  typedef A1 First;
+  typedef A2 Second;
+  enum { COUNT = 2, LENGTH = A1::WIDTH + A2::WIDTH + 2 };
+};
+
+template <class A1>
+struct Arguments<A1, NoField>
+{
+  typedef A1 First;
+  typedef NoField Second;
+  enum { COUNT = 1, LENGTH = A1::WIDTH + 1 };
+};
+
+template <>
+struct Arguments<NoField, NoField>
+{
+  typedef NoField First;
+  typedef NoField Second;
+  enum { COUNT = 0, LENGTH = 0 };
+};
+
+//Response made of just the packet terminator
+struct Ack
+{
+  enum { COUNT = 0 };
+};
+
+//Response made of up to COUNT space separated fields of the same layout,
+//decoded into values of type T; fewer than MIN_COUNT fields is an error
+template <class F, typename T, int Count, int MinCount = Count>
+struct Fields
+{
+  typedef F Field;
+  typedef T Type;
+  enum { COUNT = Count, MIN_COUNT = MinCount };
+};
+
+//Returns 16 bits representing the Firmware version: "VER"
+struct Ver
+{
+  static const char* opcode() { return "VER"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<4, false>, uint16_t, 1> Reply;
+};
+
+//Sets specific GPIO pins to output using a 20 bit mask: "OUT"
+struct Out
+{
+  static const char* opcode() { return "OUT"; }
+  typedef Arguments<Hex<5, false> > Args;
+  typedef Ack Reply;
+};
+
+//Sets specific GPIO pins to input using a 20 bit mask: "IN"
+struct In
+{
+  static const char* opcode() { return "IN"; }
+  typedef Arguments<Hex<5, false> > Args;
+  typedef Ack Reply;
+};
+
+//Sets specific GPIO output pins to high using a 20 bit mask: "HIGH"
+struct High
+{
+  static const char* opcode() { return "HIGH"; }
+  typedef Arguments<Hex<5, false> > Args;
+  typedef Ack Reply;
+};
+
+//Sets specific GPIO output pins to low using a 20 bit mask: "LOW"
+struct Low
+{
+  static const char* opcode() { return "LOW"; }
+  typedef Arguments<Hex<5, false> > Args;
+  typedef Ack Reply;
+};
+
+//Return 20 bits representing a high/low state of all GPIO pins: "READ"
+struct Read
+{
+  static const char* opcode() { return "READ"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<5, false>, uint32_t, 1> Reply;
+};
+
+//Return the ADC values as 8 separate 12 bits words: "ADC"
+struct Adc
+{
+  static const char* opcode() { return "ADC"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<3, false>, uint16_t, 8, 1> Reply;
+};
+
+//Return the digital PING values as 10|N separate 12 bits words: "PING"
+struct Ping
+{
+  static const char* opcode() { return "PING"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<3, false>, uint16_t, 10, 1> Reply;
+};
+
+//Sets drive power using 8 bits (signed) for each wheel -128|-127 is full reverse, 127 is full forward: "GO"
+struct Go
+{
+  static const char* opcode() { return "GO"; }
+  typedef Arguments<Hex<2, true>, Hex<2, true> > Args;
+  typedef Ack Reply;
+};
+
+//Sets drive speed using 16 bits (signed) for each wheel: "GOSPD"
+struct GoSpd
+{
+  static const char* opcode() { return "GOSPD"; }
+  typedef Arguments<Hex<4, true>, Hex<4, true> > Args;
+  typedef Ack Reply;
+};
+
+//Sets drive distance and speed using 16 bits (signed) and 16 bits, respectively: "TRVL"
+struct Trvl
+{
+  static const char* opcode() { return "TRVL"; }
+  typedef Arguments<Hex<4, true>, Hex<4, false> > Args;
+  typedef Ack Reply;
+};
+
+//Sets a gradual slow down to stop distance using 16 bits: "STOP"
+struct Stop
+{
+  static const char* opcode() { return "STOP"; }
+  typedef Arguments<Hex<4, false> > Args;
+  typedef Ack Reply;
+};
+
+//Sends a rotate in place degrees and speed using 16 bits (signed) and 16 bits, respectively: "TURN"
+struct Turn
+{
+  static const char* opcode() { return "TURN"; }
+  typedef Arguments<Hex<4, true>, Hex<4, false> > Args;
+  typedef Ack Reply;
+};
+
+//Returns the current speed of each wheel as 16 bits (signed): "SPD"
+struct Spd
+{
+  static const char* opcode() { return "SPD"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<4, true>, int16_t, 2> Reply;
+};
+
+//Returns the current heading, relative to start or last resetted, as 12 bits: "HEAD"
+struct Head
+{
+  static const char* opcode() { return "HEAD"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<3, false>, uint16_t, 1> Reply;
+};
+
+//Returns the left and right encoder ticks as a pair of signed 32 bits: "DIST"
+struct Dist
+{
+  static const char* opcode() { return "DIST"; }
+  typedef Arguments<> Args;
+  typedef Fields<Hex<8, true>, int32_t, 2> Reply;
+};
+
+//Zeros out the internal registers where encoder ticks are accumulated: "RST"
+struct Rst
+{
+  static const char* opcode() { return "RST"; }
+  typedef Arguments<> Args;
+  typedef Ack Reply;
+};
+
+//Sets a velocity ramping value for drive system: "ACC"
+struct Acc
+{
+  static const char* opcode() { return "ACC"; }
+  typedef Arguments<Hex<4, false> > Args;
+  typedef Ack Reply;
+};
+
+//Commands that may be written again when their response is lost. TRVL and
+//TURN move relative to where the robot is, a second one would move it twice.
+template <class C>
+struct Repeatable
+{
+  enum { VALUE = true };
+};
+
+template <>
+struct Repeatable<Trvl>
+{
+  enum { VALUE = false };
+};
+
+template <>
+struct Repeatable<Turn>
+{
+  enum { VALUE = false };
+};
+
+//Commands that set the drive. The driver keeps polling at full rate while
+//these are being sent.
+template <class C>
+struct Motion
+{
+  enum { VALUE = false };
+};
+
+template <>
+struct Motion<Go>
+{
+  enum { VALUE = true };
+};
+
+template <>
+struct Motion<GoSpd>
+{
+  enum { VALUE = true };
+};
+
+template <>
+struct Motion<Trvl>
+{
+  enum { VALUE = true };
+};
+
+template <>
+struct Motion<Stop>
+{
+  enum { VALUE = true };
+};
+
+template <>
+struct Motion<Turn>
+{
+  enum { VALUE = true };
+};
+
+//Drive commands that move the robot forward with the given arguments, which
+//the reflex stop refuses while an obstacle is in front
+template <class C>
+struct Forward
+{
+  static bool moves(long, long) { return false; }
+};
+
+template <>
+struct Forward<Go>
+{
+  static bool moves(long left, long right) { return left + right > 0; }
+};
+
+template <>
+struct Forward<GoSpd>
+{
+  static bool moves(long left, long right) { return left + right > 0; }
+};
+
+template <>
+struct Forward<Trvl>
+{
+  static bool moves(long distance, long) { return distance > 0; }
+};
+
+//Packet terminator: '\r'
+const char PACKET_TERMINATOR = '\r';
+
+//Parameter delimiter, a space character: ' '
+const char PARAMETER_DELIMITER = ' ';
+
+//A series of 3 carriage returns resets the FW serial buffer: "\r\r\r"
+const char FLUSH_BUFFERS[] = "\r\r\r";
+
+//Encoded command, ready to be written to the serial port
+struct Frame
+{
+  enum { CAPACITY = 32 };
+  char data[CAPACITY];
+  size_t size;
+  const char* opcode;
+  bool repeatable;
+  //only reads the board, so identical queries in flight can share a response
+  bool query;
+  bool motion;
+  bool forward;
+};
+
+namespace detail
+{
+
+template <class F>
+inline bool fits(long value)
+{
+  if (F::SIGNED)
+    return value >= -(1L << (F::WIDTH * 4 - 1)) && value < (1L << (F::WIDTH * 4 - 1));
+  return value >= 0 && value < (1L << (F::WIDTH * 4));
+}
+
+inline void begin(Frame &frame, const char* opcode, bool repeatable, bool query, bool motion)
+{
+  frame.motion = motion;
+  frame.forward = false;
+  frame.opcode = opcode;
+  frame.repeatable = repeatable;
+  frame.query = query;
+  frame.size = strlen(opcode);
+  memcpy(frame.data, opcode, frame.size);
+}
+
+//Appends a delimiter and the value masked to the field width, in hex
+template <class F>
+inline void append(Frame &frame, long value)
+{
+  static const char digits[] = "0123456789abcdef";
+  unsigned long masked = (unsigned long)value & ((1UL << (F::WIDTH * 4)) - 1);
+  char reversed[F::WIDTH];
+  int n = 0;
+  do
+  {
+    reversed[n++] = digits[masked & 0xF];
+    masked >>= 4;
+  }
+  while (masked && n < F::WIDTH);
+  frame.data[frame.size++] = PARAMETER_DELIMITER;
+  while (n > 0)
+    frame.data[frame.size++] = reversed[--n];
+}
+
+inline void end(Frame &frame)
+{
+  frame.data[frame.size++] = PACKET_TERMINATOR;
+}
+
+inline int hexDigit(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+}
+
+//True if value can be encoded in the given argument field without truncation
+template <class F>
+inline bool fits(long value)
+{
+  return detail::fits<F>(value);
+}
+
+template <class C>
+inline Frame encode()
+{
+  BOOST_STATIC_ASSERT(C::Args::COUNT == 0);
+  Frame frame;
+  detail::begin(frame, C::opcode(), Repeatable<C>::VALUE, C::Reply::COUNT != 0, Motion<C>::VALUE);
+  detail::end(frame);
+  return frame;
+}
+
+template <class C>
+inline Frame encode(long arg1)
+{
+  BOOST_STATIC_ASSERT(C::Args::COUNT == 1);
+  Frame frame;
+  detail::begin(frame, C::opcode(), Repeatable<C>::VALUE, C::Reply::COUNT != 0, Motion<C>::VALUE);
+  detail::append<typename C::Args::First>(frame, arg1);
+  detail::end(frame);
+  return frame;
+}
+
+template <class C>
+inline Frame encode(long arg1, long arg2)
+{
+  BOOST_STATIC_ASSERT(C::Args::COUNT == 2);
+  BOOST_STATIC_ASSERT(C::Args::LENGTH + 8 <= Frame::CAPACITY);
+  Frame frame;
+  detail::begin(frame, C::opcode(), Repeatable<C>::VALUE, C::Reply::COUNT != 0, Motion<C>::VALUE);
+  detail::append<typename C::Args::First>(frame, arg1);
+  detail::append<typename C::Args::Second>(frame, arg2);
+  detail::end(frame);
+  frame.forward = Forward<C>::moves(arg1, arg2);
+  return frame;
+}
+
+//True if the response is the bare acknowledgement of a command without reply fields
+template <class C>
+inline bool acknowledged(const std::string &response)
+{
+  BOOST_STATIC_ASSERT(C::Reply::COUNT == 0);
+  return response.size() == 1 && response[0] == PACKET_TERMINATOR;
+}
+
+//Decodes the response fields into values, returning how many were decoded,
+//or -1 for an ERROR response or one with fewer than MIN_COUNT fields
+template <class C>
+inline int decode(const std::string &response, typename C::Reply::Type (&values)[C::Reply::COUNT])
+{
+  typedef typename C::Reply Reply;
+  typedef typename Reply::Field Field;
+
+  if (response.compare(0, 5, "ERROR") == 0)
+    return -1;
+
+  int count = 0;
+  size_t pos = 0;
+  while (count < Reply::COUNT && pos + Field::WIDTH <= response.size())
+  {
+    unsigned long value = 0;
+    for (int i = 0; i < Field::WIDTH; i++)
+    {
+      int digit = detail::hexDigit(response[pos + i]);
+      if (digit < 0)
+        return count >= Reply::MIN_COUNT ? count : -1;
+      value = (value << 4) | digit;
+    }
+    if (Field::SIGNED && (value & (1UL << (Field::WIDTH * 4 - 1))))
+      values[count++] = (typename Reply::Type)((long)value - (1L << (Field::WIDTH * 4)));
+    else
+      values[count++] = (typename Reply::Type)value;
+
+    pos += Field::WIDTH;
+    if (pos >= response.size() || response[pos] != PARAMETER_DELIMITER)
+      break;
+    pos++;
+  }
+  return count >= Reply::MIN_COUNT ? count : -1;
+}
+
+
+namespace detail
+{
+
+template <class C, int Count = C::Args::COUNT>
+struct Checked;
+
+template <class C>
+struct Checked<C, 0>
+{
+  static bool apply(long, long, Frame &frame)
+  {
+    frame = encode<C>();
+    return true;
+  }
+};
+
+template <class C>
+struct Checked<C, 1>
+{
+  static bool apply(long arg1, long, Frame &frame)
+  {
+    if (!fits<typename C::Args::First>(arg1))
+      return false;
+    frame = encode<C>(arg1);
+    return true;
+  }
+};
+
+template <class C>
+struct Checked<C, 2>
+{
+  static bool apply(long arg1, long arg2, Frame &frame)
+  {
+    if (!fits<typename C::Args::First>(arg1) || !fits<typename C::Args::Second>(arg2))
+      return false;
+    frame = encode<C>(arg1, arg2);
+    return true;
+  }
+};
+
+template <class C, bool Acknowledged = (C::Reply::COUNT == 0)>
+struct Values
+{
+  static bool apply(const std::string &response, std::vector<int32_t> &values)
+  {
+    typename C::Reply::Type fields[C::Reply::COUNT];
+    int count = decode<C>(response, fields);
+    if (count < 0)
+      return false;
+    values.assign(fields, fields + count);
+    return true;
+  }
+};
+
+template <class C>
+struct Values<C, true>
+{
+  static bool apply(const std::string &response, std::vector<int32_t> &values)
+  {
+    values.clear();
+    return acknowledged<C>(response);
+  }
+};
+
+}
+
+//Encodes C from arguments chosen at run time, ignoring the ones C does not
+//take. Returns false, leaving frame untouched, if an argument does not fit.
+template <class C>
+inline bool encodeChecked(long arg1, long arg2, Frame &frame)
+{
+  return detail::Checked<C>::apply(arg1, arg2, frame);
+}
+
+//Decodes the response of any command into values, none for a command that
+//is only acknowledged. Returns false for an ERROR or malformed response.
+template <class C>
+inline bool decodeValues(const std::string &response, std::vector<int32_t> &values)
+{
+  return detail::Values<C>::apply(response, values);
+}
+
+}
+
+#endif	/* _EDDIE_COMMANDS_H */
@@ -36,30 +36,105 @@
 #define	_EDDIE_CONTROLLER_H
 
 #include <ros/ros.h>
+#include <vector>
+#include "eddie_realtime.h"
+#include "eddie_motor_table.h"
 #include <parallax_eddie_robot/Velocity.h>
+#include <parallax_eddie_robot/Path.h>
+#include <parallax_eddie_robot/PathFeedback.h>
+#include <parallax_eddie_robot/Distances.h>
+#include <parallax_eddie_robot/Voltages.h>
+#include <parallax_eddie_robot/DriveClosedLoop.h>
 #include <parallax_eddie_robot/DriveWithDistance.h>
 #include <parallax_eddie_robot/DriveWithPower.h>
 #include <parallax_eddie_robot/DriveWithSpeed.h>
+#include <parallax_eddie_robot/FollowPath.h>
 #include <parallax_eddie_robot/Rotate.h>
 #include <parallax_eddie_robot/StopAtDistance.h>
+#include <parallax_eddie_robot/TraceEvent.h>
 
 class EddieController
 {
 public:
   EddieController();
 
+  //Real-time settings for the thread that spins the controller
+  const eddie_realtime::Config& realtime() const;
+
 private:
   ros::NodeHandle node_handle_;
   ros::Subscriber velocity_sub_;
+  ros::Subscriber path_sub_;
+  ros::Subscriber path_feedback_sub_;
+  ros::Subscriber distances_sub_;
+  ros::Subscriber ir_sub_;
   ros::ServiceClient eddie_drive_power_;
+  ros::ServiceClient eddie_drive_closed_loop_;
+  ros::ServiceClient eddie_follow_path_;
   ros::ServiceClient eddie_turn_;
   ros::ServiceClient eddie_stop_;
+  ros::Publisher trace_pub_;
 
   int left_power_, right_power_, rotation_speed_;
+  bool closed_loop_;
+  int wheel_speed_;
+
+  //With a motor_calibration_file, open-loop commands are worked out as wheel
+  //speeds like closed-loop ones, and the table gives the power for each wheel
+  EddieMotorTable motor_table_;
+
+  //Obstacle governor: linear commands are scaled by the clearance reported by
+  //the ping sensors facing the direction of travel. Clearances are reduced to
+  //a single value when a reading arrives so the command path only compares.
+  //Without a reading newer than governor_timeout the robot is held to
+  //governor_crawl_scale, rotation included, and the timer applies that to a
+  //motion under way once the readings stop.
+  bool governor_enabled_;
+  std::vector<int> front_sensors_, rear_sensors_;
+  double governor_stop_distance_, governor_slow_distance_, governor_timeout_;
+  double governor_crawl_scale_;
+  ros::Timer governor_timer_;
+  double governor_ir_stop_voltage_;
+  int front_clearance_, rear_clearance_;
+  bool ir_blocked_;
+  ros::Time clearance_stamp_, ir_stamp_;
+  float last_linear_, last_scale_;
+  int16_t last_angular_;
+
+  //A path is handed to the driver once and tracked there, the governor can
+  //only stop it: on an obstacle, or from the timer once the readings stop
+  uint32_t path_id_;
+  bool following_path_;
+
+  //Velocity commands are expected to be handled within controller_deadline.
+  //Their delivery latency is measured from the trace origin when there is one
+  eddie_realtime::Config realtime_;
+  eddie_realtime::CycleStats velocity_stats_;
+
+  //Trace of the velocity command being handled, carried into service requests
+  bool trace_enabled_;
+  parallax_eddie_robot::Trace current_trace_;
 
   void velocityCallback(const parallax_eddie_robot::Velocity::ConstPtr& message);
+  void pathCallback(const parallax_eddie_robot::Path::ConstPtr& message);
+  void pathFeedbackCallback(const parallax_eddie_robot::PathFeedback::ConstPtr& message);
+  void distancesCallback(const parallax_eddie_robot::Distances::ConstPtr& message);
+  void irCallback(const parallax_eddie_robot::Voltages::ConstPtr& message);
+  void governorTimerCallback(const ros::TimerEvent& event);
+  void readSensorList(std::string name, std::vector<int> &sensors);
+  float governorScale(float linear);
+  bool governorFresh(ros::Time now) const;
+  bool governorBlind(ros::Time now) const;
+  int16_t governorAngular(float linear, float scale, int16_t angular);
+  void applyGovernor();
+  void move(float linear, int16_t angular);
+  void trace(uint8_t stage);
+  template <class Service> bool call(ros::ServiceClient &client, Service &service);
   void stop();
   int8_t clipPower(int power_unit, float linear);
+  bool speedUnits() const;
+  int16_t clipSpeed(int speed_unit, float linear);
+  bool drive(int left, int right);
   void moveLinear(float linear);
   void moveAngular(int16_t angular);
   void moveLinearAngular(float linear, int16_t angular);
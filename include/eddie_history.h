@@ -0,0 +1,87 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_HISTORY_H
+#define	_EDDIE_HISTORY_H
+
+#include <ros/ros.h>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+//==============================================================================//
+// Fixed capacity history of one timestamped quantity (encoder ticks, heading  //
+// or wheel speeds), queried by time. Queries binary search the ring and      //
+// interpolate between the two samples around the requested instant, or      //
+// extrapolate a short way past the newest one. Readers take no lock: every   //
+// slot carries a sequence number that is odd while it is being written, and  //
+// a query that overlaps a write simply looks again. Writers are serialized   //
+// and keep the ring in time order by dropping samples older than the newest. //
+//==============================================================================//
+
+class EddieHistory
+{
+public:
+  enum { FIELDS = 2 };
+
+  //wrap is the period of a circular quantity, e.g. 360 for a heading, or 0
+  EddieHistory(size_t capacity, double wrap = 0);
+
+  void record(ros::Time stamp, double first, double second = 0);
+
+  //Fills values for stamp, which must not be older than the oldest sample
+  //nor more than max_extrapolation seconds past the newest. Returns false
+  //otherwise or if there are fewer than two samples.
+  bool query(ros::Time stamp, double max_extrapolation, double (&values)[FIELDS], bool &extrapolated) const;
+
+  size_t capacity() const;
+
+private:
+  struct Slot
+  {
+    volatile uint32_t sequence;
+    int64_t stamp;
+    double value[FIELDS];
+  };
+
+  std::vector<Slot> slots_;
+  double wrap_;
+  volatile uint64_t count_;
+  boost::mutex write_mutex_;
+
+  bool readSlot(uint64_t index, Slot &slot) const;
+  double interpolate(double from, double to, double fraction) const;
+};
+
+#endif	/* _EDDIE_HISTORY_H */
@@ -0,0 +1,118 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_IO_H
+#define	_EDDIE_IO_H
+
+#include <ros/ros.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <boost/thread.hpp>
+#include "eddie_realtime.h"
+
+//==============================================================================//
+// Serial I/O shared by every Eddie board served from one process. A single     //
+// epoll thread reads from all the serial ports and hands complete responses   //
+// to the thread waiting in transact(), which sleeps instead of polling the    //
+// port, so adding boards does not add busy threads.                           //
+//==============================================================================//
+
+class EddieIO
+{
+public:
+  EddieIO();
+  virtual ~EddieIO();
+
+  //Runs the I/O thread SCHED_FIFO at priority, pinned to cpus when given
+  void setRealtime(int priority, const std::vector<int> &cpus);
+
+  //Opens and configures a serial port, returns the channel or -1 on failure
+  int open(std::string port);
+  void close(int channel);
+
+  //Writes a command and waits for the response up to the packet terminator.
+  //Returns false if the whole response did not arrive within timeout seconds.
+  //received_time is when the I/O thread read the terminator, not when the
+  //caller woke up. round_trip is measured on the monotonic clock, so it stays
+  //right under simulated time, and so do the timeouts.
+  bool transact(int channel, const char* data, size_t size, std::string &response,
+                ros::Time *written_time, ros::Time *received_time, double *round_trip,
+                double timeout);
+
+  //One command of a pipelined batch, with its response and timings filled in
+  struct Request
+  {
+    const char* data;
+    size_t size;
+    double timeout;
+    std::string response;
+    ros::Time written_time, received_time;
+    double round_trip;  //seconds on the monotonic clock, for answered requests
+  };
+
+  //Writes the requests back to back, keeping at most window bytes of commands
+  //unanswered so the other end's input buffer cannot overflow, and reads the
+  //responses in order. Each response must arrive within its timeout of the
+  //later of its write and the previous response. Returns how many requests
+  //were answered; the ones after a missing response get none.
+  size_t pipeline(int channel, std::vector<Request> &requests, size_t window);
+
+  //Writes data meant to reset the other end, then discards everything that
+  //arrives until the line has been quiet for settle_time seconds
+  void resync(int channel, const char* data, size_t size, double settle_time);
+
+private:
+  struct Channel
+  {
+    std::string port;
+    std::string pending;
+    ros::Time last_read;
+    double last_read_clock;
+    eddie_realtime::MonotonicCondition received;
+  };
+
+  boost::mutex mutex_;
+  std::map<int, Channel*> channels_;
+  int epoll_fd_;
+  int wake_pipe_[2];
+  bool running_;
+  boost::thread io_thread_;
+
+  void ioLoop();
+  bool writeAll(int fd, const char* data, size_t size, double timeout);
+  bool waitWritable(int fd, double timeout);
+};
+
+#endif	/* _EDDIE_IO_H */
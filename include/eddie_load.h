@@ -0,0 +1,102 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_LOAD_H
+#define	_EDDIE_LOAD_H
+
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <parallax_eddie_robot/ADC.h>
+#include <parallax_eddie_robot/Ping.h>
+
+//==============================================================================//
+// Service load generator for the eddie driver, against a board or eddie_sim.   //
+// load_clients threads call a weighted mix of get_distance, get_speed,         //
+// get_heading and drive_with_power as fast as they are answered (or at         //
+// load_client_rate each) for load_duration seconds, after a quiet period of    //
+// load_baseline seconds. Reports calls per second, error rates and latency     //
+// percentiles per service, and the ping/ADC publishing jitter measured while   //
+// quiet and under load. Topics and services are those of the board in          //
+// load_topic_namespace; load_service_namespace overrides the services' one.    //
+//==============================================================================//
+
+class EddieLoad
+{
+public:
+  EddieLoad();
+
+  //Runs the quiet period and the load, then prints the report
+  void run();
+
+private:
+  enum Service { GET_DISTANCE, GET_SPEED, GET_HEADING, DRIVE_WITH_POWER, SERVICE_COUNT };
+
+  struct Call
+  {
+    uint8_t service;
+    bool ok;
+    float latency;
+  };
+
+  //Arrival times of a published topic, split by phase
+  struct Arrivals
+  {
+    std::vector<double> quiet, loaded;
+  };
+
+  ros::NodeHandle node_handle_;
+  std::string service_namespace_;
+  ros::Subscriber ping_sub_;
+  ros::Subscriber adc_sub_;
+  int clients_;
+  double duration_, baseline_, client_rate_;
+  double weights_[SERVICE_COUNT];
+  int drive_power_;
+
+  boost::mutex arrivals_mutex_;
+  bool loaded_;
+  Arrivals ping_arrivals_, adc_arrivals_;
+
+  void pingCallback(const parallax_eddie_robot::Ping::ConstPtr& message);
+  void adcCallback(const parallax_eddie_robot::ADC::ConstPtr& message);
+  void record(Arrivals &arrivals);
+  void client(int index, ros::WallTime end, std::vector<Call> *calls);
+  bool call(int service, std::vector<ros::ServiceClient> &services);
+  void reportJitter(const char* topic, Arrivals &arrivals);
+  double percentile(std::vector<double> &values, double p);
+};
+
+#endif	/* _EDDIE_LOAD_H */
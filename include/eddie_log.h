@@ -0,0 +1,179 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_LOG_H
+#define	_EDDIE_LOG_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+//==============================================================================//
+// Columnar telemetry log. Each sensor stream is written to its own segment    //
+// files, preallocated to a fixed size and memory mapped. A segment holds a    //
+// header, a column of timestamps and one fixed-width column per field, so a   //
+// reader can scan any column without parsing. Segments roll over when full.   //
+// Producers only copy a sample into a queue and never wait for the disk: if   //
+// the queue is busy or full the sample is dropped and counted.               //
+//==============================================================================//
+
+namespace eddie_log
+{
+
+enum Stream
+{
+  PING = 0,
+  ADC = 1,
+  ENCODER = 2,
+  HEADING = 3,
+  SPEED = 4,
+  STREAM_COUNT = 5
+};
+
+//Most fields in any stream: 10 ping sensors
+const int MAX_FIELDS = 10;
+
+//Layout of the fields of a stream, the same in every segment of that stream
+struct StreamLayout
+{
+  const char* name;
+  uint8_t field_count;
+  uint8_t field_size;
+  uint8_t field_signed;
+};
+
+const StreamLayout STREAM_LAYOUTS[STREAM_COUNT] = {
+  { "ping", 10, 2, 0 },
+  { "adc", 8, 2, 0 },
+  { "encoder", 2, 4, 1 },
+  { "heading", 1, 2, 0 },
+  { "speed", 2, 2, 1 }
+};
+
+const char SEGMENT_MAGIC[8] = { 'E', 'D', 'D', 'I', 'E', 'L', 'O', 'G' };
+const uint16_t SEGMENT_VERSION = 1;
+
+//Start of every segment file. The timestamp column (int64 nanoseconds) starts
+//at HEADER_SIZE, followed by field_count columns of field_size bytes, each
+//column capacity entries long. count is only advanced after a sample is
+//completely written, so a segment is consistent even if the writer dies.
+struct SegmentHeader
+{
+  char magic[8];
+  uint16_t version;
+  uint8_t stream;
+  uint8_t field_count;
+  uint8_t field_size;
+  uint8_t field_signed;
+  uint16_t reserved;
+  uint32_t capacity;
+  volatile uint32_t count;
+  int64_t first_stamp;
+  int64_t last_stamp;
+};
+
+const size_t HEADER_SIZE = 64;
+
+inline size_t timestampColumn(const SegmentHeader &)
+{
+  return HEADER_SIZE;
+}
+
+inline size_t fieldColumn(const SegmentHeader &header, int field)
+{
+  return HEADER_SIZE + header.capacity * sizeof (int64_t) + (size_t)field * header.capacity * header.field_size;
+}
+
+//Samples that fit a segment of the given size
+inline uint32_t segmentCapacity(size_t segment_size, const StreamLayout &layout)
+{
+  return (segment_size - HEADER_SIZE) / (sizeof (int64_t) + layout.field_count * layout.field_size);
+}
+
+struct Sample
+{
+  uint8_t stream;
+  int64_t stamp;
+  int32_t value[MAX_FIELDS];
+};
+
+class Writer
+{
+public:
+  //Writes segments named <prefix>_<stream>_<start time>_<sequence>.seg into
+  //directory, each segment_size bytes, buffering up to queue_size samples
+  Writer(std::string directory, std::string prefix, size_t segment_size, size_t queue_size);
+  virtual ~Writer();
+
+  //Queues a sample without blocking, returns false if it had to be dropped
+  bool record(const Sample &sample);
+
+  uint64_t written() const;
+  uint64_t dropped() const;
+
+private:
+  struct Segment
+  {
+    int fd;
+    char* base;
+    SegmentHeader* header;
+    uint32_t sequence;
+  };
+
+  std::string directory_;
+  std::string prefix_;
+  size_t segment_size_;
+
+  boost::mutex queue_mutex_;
+  std::vector<Sample> queue_;
+  size_t queue_head_, queue_tail_;
+  //drain() moves the whole queue here under one lock
+  std::vector<Sample> batch_;
+  //Updated atomically, so that they can be read without the queue lock
+  volatile uint64_t written_, dropped_;
+
+  Segment segments_[STREAM_COUNT];
+  boost::thread writer_thread_;
+
+  void writerLoop();
+  void drain();
+  void append(const Sample &sample);
+  bool openSegment(int stream);
+  void closeSegment(int stream);
+};
+
+}
+
+#endif	/* _EDDIE_LOG_H */
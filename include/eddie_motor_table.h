@@ -0,0 +1,88 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_MOTOR_TABLE_H
+#define	_EDDIE_MOTOR_TABLE_H
+
+#include <string>
+#include <vector>
+
+//==============================================================================//
+// Measured GO power to wheel speed curve of each motor, as written by          //
+// eddie_calibrate. Turning it around gives the power that makes each wheel     //
+// turn at a given speed, so both wheels of a mismatched pair can be sent to    //
+// the same speed with one open-loop command at any speed, not just the one     //
+// a pair of power scalars was tuned at. Speeds are in encoder ticks per        //
+// second and are interpolated linearly between the measured power levels.      //
+//                                                                              //
+// The file holds one "power left_speed right_speed" line per level, lines      //
+// starting with # are comments.                                                //
+//==============================================================================//
+
+class EddieMotorTable
+{
+public:
+  enum Wheel { LEFT, RIGHT };
+
+  EddieMotorTable();
+
+  bool load(const std::string &path);
+  bool save(const std::string &path) const;
+
+  //Adds or replaces the speeds measured at power
+  void add(int power, double left_speed, double right_speed);
+  bool empty() const;
+  size_t size() const;
+
+  //Power that turns wheel at speed, the strongest measured power for a speed
+  //out of reach, and 0 for 0
+  int power(Wheel wheel, double speed) const;
+
+  //Fastest speed both wheels reach in the direction of speed's sign, the
+  //lower of the two wheels' top speeds. Targets beyond it are to be scaled
+  //down on both wheels, as a weaker wheel saturating alone bends the path.
+  double maxSpeed(double speed) const;
+
+private:
+  struct Entry
+  {
+    int power;
+    double speed[2];
+  };
+
+  //sorted by power, always with an entry for power 0
+  std::vector<Entry> entries_;
+};
+
+#endif	/* _EDDIE_MOTOR_TABLE_H */
@@ -0,0 +1,80 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_ODOMETRY_H
+#define	_EDDIE_ODOMETRY_H
+
+#include <stdint.h>
+
+//==============================================================================//
+// Dead reckoning from the wheel encoders, shared by the processing stage and  //
+// the path tracker. Distance is the mean of both wheels. Direction comes from //
+// the board's gyro heading when a reading is given for both ends of a step,   //
+// and from the wheel differential over wheel_base otherwise.                  //
+//==============================================================================//
+
+class EddieOdometry
+{
+public:
+  EddieOdometry();
+
+  //wheel_base is only used for steps without a gyro heading
+  void setGeometry(double wheel_radius, int ticks_per_revolution, double wheel_base);
+
+  //Moves the pose to x, y, theta and forgets the last readings, so that the
+  //next update only takes them as the reference
+  void reset(double x = 0, double y = 0, double theta = 0);
+
+  //Advances the pose to cumulative wheel ticks and, with has_heading, a gyro
+  //heading in radians. Returns false for the reference reading after a reset.
+  bool update(int32_t left_ticks, int32_t right_ticks, bool has_heading, double heading);
+
+  double x() const;
+  double y() const;
+  double theta() const;
+
+  //Meters driven and radians turned in the last step
+  double distance() const;
+  double turned() const;
+
+private:
+  double meters_per_tick_, wheel_base_;
+  double x_, y_, theta_;
+  double distance_, turned_;
+  bool referenced_, last_has_heading_;
+  int32_t last_left_, last_right_;
+  double last_heading_;
+};
+
+#endif	/* _EDDIE_ODOMETRY_H */
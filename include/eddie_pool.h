@@ -0,0 +1,108 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_POOL_H
+#define	_EDDIE_POOL_H
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+//==============================================================================//
+// Fixed pool of worker threads with one task deque each. A worker runs its    //
+// own tasks newest first and, when it runs out, steals the oldest task of     //
+// another worker, so an uneven batch still spreads over every thread. Tasks   //
+// are submitted through a Group, whose wait() joins them and runs queued      //
+// tasks on the calling thread meanwhile instead of just blocking it.          //
+//==============================================================================//
+
+class EddiePool
+{
+public:
+  typedef boost::function<void ()> Task;
+
+  class Group
+  {
+  public:
+    explicit Group(EddiePool &pool);
+
+    void run(const Task &task);
+
+    //Returns once every task run through this group has finished
+    void wait();
+
+  private:
+    friend class EddiePool;
+    EddiePool &pool_;
+    volatile int pending_;
+  };
+
+  explicit EddiePool(int threads);
+  virtual ~EddiePool();
+
+  int size() const;
+
+  //Runs the workers SCHED_FIFO at priority, pinned to cpus when given
+  void setRealtime(int priority, const std::vector<int> &cpus);
+
+private:
+  struct Job
+  {
+    Task task;
+    Group *group;
+  };
+
+  struct Worker
+  {
+    boost::mutex mutex;
+    std::deque<Job> jobs;
+    boost::thread thread;
+  };
+
+  std::vector<Worker*> workers_;
+  boost::mutex idle_mutex_;
+  boost::condition_variable work_available_;
+  boost::mutex done_mutex_;
+  boost::condition_variable group_done_;
+  volatile int queued_;
+  unsigned next_;
+  bool running_;
+
+  void submit(const Job &job);
+  bool runOne(int index);
+  void workerLoop(int index);
+};
+
+#endif	/* _EDDIE_POOL_H */
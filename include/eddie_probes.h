@@ -0,0 +1,129 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_PROBES_H
+#define	_EDDIE_PROBES_H
+
+//==============================================================================//
+// Static tracepoints (USDT, provider "eddie") on the driver, controller and    //
+// teleop hot paths, for perf, bpftrace and SystemTap. With <sys/sdt.h>         //
+// (HAVE_SYS_SDT_H, set by the build when found) each probe is a single nop     //
+// plus an ELF note, and fires whether or not its semaphore is raised. Only     //
+// the clock reads that feed durations and ages test the semaphore, which the   //
+// tracer raises while attached (perf from Linux 4.20); with it down they read  //
+// 0. Without <sys/sdt.h> all of it compiles to nothing.                        //
+//                                                                              //
+//   bpftrace -e 'usdt:bin/eddie:eddie:command__done                            //
+//                { @us[str(arg0)] = hist(arg3 / 1000); }'                      //
+//                                                                              //
+//   perf buildid-cache --add bin/eddie                                         //
+//   perf probe sdt_eddie:command__done                                         //
+//   perf record -e sdt_eddie:command__done -p $(pidof eddie)                   //
+//                                                                              //
+// Probes, durations in nanoseconds:                                            //
+//   command__start(opcode, bytes)         every command written to the board   //
+//   command__done(opcode, bytes, response_bytes, duration)                     //
+//   serial__pass(commands, sent, duration)                                     //
+//   ping__parse(values, response_bytes, duration, ok)                          //
+//   adc__parse(values, response_bytes, duration, ok)                           //
+//   ping__publish(values, age)   adc__publish(values, age)                     //
+//   velocity__done(linear * 1000, angular * 1000, latency, duration)           //
+//   key__publish(keycode, duration)                                            //
+//==============================================================================//
+
+#ifdef HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#include <stdint.h>
+#include <time.h>
+
+//One semaphore per probe, weak so that every source file of a binary can
+//include this header
+#define EDDIE_PROBE_SEMAPHORE(probe) \
+  __extension__ unsigned short eddie_##probe##_semaphore \
+  __attribute__ ((unused)) __attribute__ ((section (".probes"))) __attribute__ ((weak)) = 0
+
+EDDIE_PROBE_SEMAPHORE(command__start);
+EDDIE_PROBE_SEMAPHORE(command__done);
+EDDIE_PROBE_SEMAPHORE(serial__pass);
+EDDIE_PROBE_SEMAPHORE(ping__parse);
+EDDIE_PROBE_SEMAPHORE(adc__parse);
+EDDIE_PROBE_SEMAPHORE(ping__publish);
+EDDIE_PROBE_SEMAPHORE(adc__publish);
+EDDIE_PROBE_SEMAPHORE(velocity__done);
+EDDIE_PROBE_SEMAPHORE(key__publish);
+
+namespace eddie_probes
+{
+
+inline uint64_t now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+}
+
+#define EDDIE_PROBE_ENABLED(probe) __builtin_expect(eddie_##probe##_semaphore != 0, 0)
+
+//Declares a start time for a later EDDIE_PROBE_SINCE in the given probe, 0
+//unless a tracer is attached to it. A tracer attaching in between reads a
+//duration of 0 for that one call.
+#define EDDIE_PROBE_CLOCK(probe, start) uint64_t start = EDDIE_PROBE_ENABLED(probe) ? eddie_probes::now() : 0
+#define EDDIE_PROBE_SINCE(start) ((start) ? eddie_probes::now() - (start) : 0)
+
+//A probe argument that costs a clock read, evaluated only while attached
+#define EDDIE_PROBE_VALUE(probe, value) (EDDIE_PROBE_ENABLED(probe) ? (value) : 0)
+
+#define EDDIE_PROBE1(probe, a1) DTRACE_PROBE1(eddie, probe, a1)
+#define EDDIE_PROBE2(probe, a1, a2) DTRACE_PROBE2(eddie, probe, a1, a2)
+#define EDDIE_PROBE3(probe, a1, a2, a3) DTRACE_PROBE3(eddie, probe, a1, a2, a3)
+#define EDDIE_PROBE4(probe, a1, a2, a3, a4) DTRACE_PROBE4(eddie, probe, a1, a2, a3, a4)
+
+#else
+
+#define EDDIE_PROBE_CLOCK(probe, start)
+#define EDDIE_PROBE_SINCE(start) 0
+#define EDDIE_PROBE_VALUE(probe, value) 0
+
+#define EDDIE_PROBE1(probe, a1) do {} while (0)
+#define EDDIE_PROBE2(probe, a1, a2) do {} while (0)
+#define EDDIE_PROBE3(probe, a1, a2, a3) do {} while (0)
+#define EDDIE_PROBE4(probe, a1, a2, a3, a4) do {} while (0)
+
+#endif
+
+#endif	/* _EDDIE_PROBES_H */
@@ -0,0 +1,120 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_PROCESSING_H
+#define	_EDDIE_PROCESSING_H
+
+#include <ros/ros.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <parallax_eddie_robot/BatteryLevel.h>
+#include <parallax_eddie_robot/Distances.h>
+#include <parallax_eddie_robot/Odometry.h>
+#include <parallax_eddie_robot/Voltages.h>
+#include "eddie_odometry.h"
+#include "eddie_pool.h"
+#include "eddie_telemetry.h"
+
+//==============================================================================//
+// In-process sensor processing on each frame the poll loop reads. Ping        //
+// filtering, IR voltages, battery level and odometry depend only on their own //
+// part of the frame and their own state, so they run as independent stages on //
+// a worker pool and are joined before anything is published. The results go  //
+// to the topics eddie_ping and eddie_adc publish, which are not needed when   //
+// this is enabled. Mean stage times, their serial sum and the time the joined //
+// graph took are reported every report_period.                                //
+//==============================================================================//
+
+class EddieProcessing
+{
+public:
+  //With threads of 0 the stages run one after another on the calling thread
+  EddieProcessing(ros::NodeHandle node_handle, std::string topic_namespace, int threads);
+  virtual ~EddieProcessing();
+
+  //Runs every stage on frame, then publishes their outputs
+  void process(const eddie_telemetry::Frame &frame);
+
+  //Runs the pool's workers SCHED_FIFO at priority, pinned to cpus when given
+  void setRealtime(int priority, const std::vector<int> &cpus);
+
+private:
+  enum Stage { PING_FILTER, IR_VOLTAGES, BATTERY_LEVEL, ODOMETRY, STAGE_COUNT };
+
+  ros::NodeHandle node_handle_;
+  ros::Publisher distances_pub_;
+  ros::Publisher ir_pub_;
+  ros::Publisher battery_pub_;
+  ros::Publisher odometry_pub_;
+  boost::scoped_ptr<EddiePool> pool_;
+  const double ADC_VOLTAGE_DIVIDER;
+  const double BATTERY_VOLTAGE_MULTIPLIER;
+
+  //Outputs of the current frame, each written only by its own stage
+  bool ready_[STAGE_COUNT];
+  parallax_eddie_robot::Distances distances_;
+  parallax_eddie_robot::Voltages voltages_;
+  parallax_eddie_robot::BatteryLevel battery_;
+  parallax_eddie_robot::Odometry odometry_;
+
+  //Median of the last ping_filter_window readings of each ping sensor,
+  //readings of 0 (no echo) are left out
+  int ping_filter_window_;
+  std::vector<std::deque<uint16_t> > ping_history_;
+
+  //Exponential smoothing of the battery voltage, 1 keeps the raw reading
+  double battery_filter_;
+  double battery_voltage_;
+
+  EddieOdometry dead_reckoning_;
+  bool has_odometry_;
+  ros::Time last_encoder_stamp_;
+
+  double report_period_;
+  ros::WallTime last_report_;
+  uint64_t frames_;
+  double stage_time_[STAGE_COUNT];
+  double graph_time_;
+
+  void runStage(int stage, const eddie_telemetry::Frame &frame);
+  bool filterPing(const eddie_telemetry::Frame &frame);
+  bool convertIR(const eddie_telemetry::Frame &frame);
+  bool updateBattery(const eddie_telemetry::Frame &frame);
+  bool updateOdometry(const eddie_telemetry::Frame &frame);
+  void report();
+};
+
+#endif	/* _EDDIE_PROCESSING_H */
@@ -0,0 +1,92 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_PURSUIT_H
+#define	_EDDIE_PURSUIT_H
+
+#include <vector>
+#include <cstddef>
+
+//==============================================================================//
+// Pure-pursuit path tracker. The path is a polyline in the frame of the pose   //
+// the robot had when it was accepted. On every update the robot is projected   //
+// onto the path, searching forward from the previous projection only so that   //
+// a path crossing itself is still followed in order, and steers along the arc  //
+// through the point lookahead meters further on. Speed is capped by the        //
+// lateral acceleration of that arc and by the distance left to stop in.        //
+//==============================================================================//
+
+class EddiePursuit
+{
+public:
+  struct Point
+  {
+    double x, y;
+  };
+
+  EddiePursuit();
+
+  void setLookahead(double lookahead);
+  void setMaxSpeed(double max_speed);
+  //max_angular bounds the turn rate, also when turning in place
+  void setLimits(double max_angular, double max_lateral_accel, double max_decel);
+  void setGoalTolerance(double tolerance);
+
+  //Starts over on path, which needs at least one point
+  void setPath(const std::vector<Point> &path);
+
+  //Returns false once the robot is within the goal tolerance of the last
+  //point, otherwise the linear (m/s) and angular (rad/s, counterclockwise)
+  //velocities to drive at from pose x, y, theta
+  bool update(double x, double y, double theta, double &linear, double &angular);
+
+  //Segment the robot was last projected onto, the distance from it and the
+  //fraction of the path's length covered
+  size_t index() const;
+  double crossTrackError() const;
+  double progress() const;
+
+private:
+  std::vector<Point> path_;
+  std::vector<double> length_;
+  double lookahead_;
+  double max_speed_, max_angular_, max_lateral_accel_, max_decel_;
+  double goal_tolerance_;
+  size_t index_;
+  double travelled_, cross_track_error_;
+
+  Point pointAt(double distance) const;
+};
+
+#endif	/* _EDDIE_PURSUIT_H */
@@ -0,0 +1,153 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_REALTIME_H
+#define	_EDDIE_REALTIME_H
+
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+//==============================================================================//
+// Opt-in real-time execution shared by the driver and the controller. When    //
+// realtime_enabled is set the process locks and prefaults its memory and the  //
+// I/O and control threads run SCHED_FIFO, pinned to realtime_cpus. Cycle      //
+// statistics are collected either way, so that jitter and deadline misses    //
+// can be compared with and without it.                                       //
+//==============================================================================//
+
+namespace eddie_realtime
+{
+
+struct Config
+{
+  bool enabled;
+  int priority;              //SCHED_FIFO priority of the most urgent thread
+  std::vector<int> cpus;     //CPUs the real-time threads may run on, empty for any
+  int heap_prefault;         //MB of heap touched and kept after mlockall
+  double report_period;      //seconds between statistics reports, 0 for none
+};
+
+//Reads the realtime_* parameters
+Config readConfig(ros::NodeHandle &node_handle);
+
+//Locks current and future memory, prefaults the stack and heap_prefault MB
+//of heap, and stops malloc from ever giving memory back to the system, so
+//the hot path neither page faults nor enters the kernel to allocate
+bool lockMemory(int heap_prefault);
+
+//Switches a thread to SCHED_FIFO at priority, pinned to cpus when given
+bool configureThread(pthread_t thread, int priority, const std::vector<int> &cpus, const char* name);
+
+//Mutex with priority inheritance: a normal thread holding it runs at the
+//priority of the highest real-time thread waiting for it, so that thread is
+//not kept waiting behind everything in between
+class PriorityMutex
+{
+public:
+  PriorityMutex();
+  ~PriorityMutex();
+
+  void lock();
+  void unlock();
+
+private:
+  pthread_mutex_t mutex_;
+
+  PriorityMutex(const PriorityMutex&);
+  PriorityMutex& operator=(const PriorityMutex&);
+};
+
+//Seconds on CLOCK_MONOTONIC, which neither jumps with the wall clock nor
+//follows simulated time, for measuring intervals and building deadlines
+double monotonicNow();
+
+//Sleeps until deadline, a monotonicNow() time
+void sleepUntil(double deadline);
+
+//Condition variable for a boost::mutex whose timed waits run on
+//CLOCK_MONOTONIC, as boost's own only wait on the system clock
+class MonotonicCondition
+{
+public:
+  MonotonicCondition();
+  ~MonotonicCondition();
+
+  //Waits until notified or until deadline, a monotonicNow() time. Returns
+  //false once the deadline has passed.
+  bool waitUntil(boost::mutex::scoped_lock &lock, double deadline);
+  void notifyOne();
+  void notifyAll();
+
+private:
+  pthread_cond_t condition_;
+
+  MonotonicCondition(const MonotonicCondition&);
+  MonotonicCondition& operator=(const MonotonicCondition&);
+};
+
+//Wake-up jitter, work time and deadline misses of a periodic or event
+//driven thread. Only touched by the thread it measures; fixed size storage
+class CycleStats
+{
+public:
+  CycleStats(const char* name, double deadline, double report_period);
+
+  void configure(double deadline, double report_period);
+
+  //lateness is how long after its due time the cycle started and duration
+  //how long its work took, in seconds. A cycle misses its deadline when
+  //lateness + duration exceeds it. Logs and restarts the statistics every
+  //report_period.
+  void record(double lateness, double duration);
+
+private:
+  enum { BUCKETS = 24 };  //power of two microsecond buckets, up to ~8 s
+
+  const char* name_;
+  double deadline_, report_period_;
+  ros::WallTime window_start_;
+  uint64_t cycles_, misses_;
+  double lateness_sum_, lateness_max_, duration_max_;
+  uint64_t histogram_[BUCKETS];
+
+  void reset();
+  double percentile(double fraction) const;
+};
+
+}
+
+#endif	/* _EDDIE_REALTIME_H */
@@ -0,0 +1,340 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_SHM_H
+#define	_EDDIE_SHM_H
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//==============================================================================//
+// Latest sensor frame of a board in POSIX shared memory, for consumers on the  //
+// same machine that do not want ROS serialization and loopback TCP for a few   //
+// dozen bytes. The driver writes the segment, named after the board, e.g.      //
+// "/eddie_sensors", when shm_enabled is set. The frame is guarded by a         //
+// seqlock: the sequence number is odd while the driver is writing, and a       //
+// reader copies the frame and only tries again if a write overlapped the       //
+// copy. Readers never block the driver, follow it across restarts, and need    //
+// nothing but this header (link with -lrt on older glibc).                     //
+//==============================================================================//
+
+namespace eddie_shm
+{
+
+const uint32_t FRAME_MAGIC = 0x45444459; //"EDDY"
+const uint32_t FRAME_VERSION = 1;
+
+//Stamps are the driver's estimated sample instants in nanoseconds since the
+//epoch, 0 until the first sample of that kind
+struct SensorFrame
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t updates;
+
+  uint64_t ping_stamp;
+  uint32_t ping_count;
+  uint16_t ping[10];
+
+  uint64_t adc_stamp;
+  uint32_t adc_count;
+  uint16_t adc[8];
+
+  uint64_t encoder_stamp;
+  int32_t left_ticks, right_ticks;
+
+  uint64_t heading_stamp;
+  uint16_t heading;
+
+  uint64_t speed_stamp;
+  int16_t left_speed, right_speed;
+};
+
+struct Segment
+{
+  volatile uint32_t sequence;
+  uint32_t reserved;
+  SensorFrame frame;
+};
+
+//Shared memory name of a board's segment, e.g. "/eddie_sensors" for "eddie"
+inline std::string segmentName(const std::string &board)
+{
+  return "/" + board + "_sensors";
+}
+
+class Reader
+{
+public:
+  //A sequence number standing still for stale_timeout seconds has the reader
+  //check whether the driver restarted and created the segment anew
+  explicit Reader(const std::string &name, double stale_timeout = 1.0) :
+    name_(name), stale_timeout_(stale_timeout), segment_(NULL), inode_(0), last_sequence_(0), last_progress_(0)
+  {
+    remap();
+  }
+
+  ~Reader()
+  {
+    if (segment_)
+      munmap((void*)segment_, sizeof (Segment));
+  }
+
+  //False until the driver has created the segment, which read() picks up
+  bool ok() const
+  {
+    return segment_ && segment_->frame.magic == FRAME_MAGIC && segment_->frame.version == FRAME_VERSION;
+  }
+
+  //Copies the newest complete frame, false if there is none or the driver
+  //kept writing through max_attempts copies
+  bool read(SensorFrame &frame, int max_attempts = 1000)
+  {
+    refresh();
+    if (!ok())
+      return false;
+    for (int attempt = 0; attempt < max_attempts; attempt++)
+    {
+      uint32_t before = segment_->sequence;
+      if (before & 1)
+        continue;
+      __sync_synchronize();
+      memcpy(&frame, (const void*)&segment_->frame, sizeof (frame));
+      __sync_synchronize();
+      if (segment_->sequence == before)
+        return true;
+    }
+    return false;
+  }
+
+private:
+  std::string name_;
+  double stale_timeout_;
+  const Segment* segment_;
+  ino_t inode_;
+  uint32_t last_sequence_;
+  double last_progress_;
+
+  static double now()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+  }
+
+  void refresh()
+  {
+    double time = now();
+    if (segment_ && segment_->sequence != last_sequence_)
+    {
+      last_sequence_ = segment_->sequence;
+      last_progress_ = time;
+      return;
+    }
+    //also spaces out the checks while there is no segment at all
+    if (time - last_progress_ >= stale_timeout_)
+      remap();
+  }
+
+  //A restarted driver unlinks the old segment and creates a new one under the
+  //same name, which only shows as a different inode. The old mapping stays
+  //readable but frozen.
+  void remap()
+  {
+    last_progress_ = now();
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return;
+    struct stat status;
+    if (fstat(fd, &status) == 0 && (!segment_ || status.st_ino != inode_) &&
+        status.st_size >= (off_t)sizeof (Segment))
+    {
+      void* mapped = mmap(NULL, sizeof (Segment), PROT_READ, MAP_SHARED, fd, 0);
+      if (mapped != MAP_FAILED)
+      {
+        if (segment_)
+          munmap((void*)segment_, sizeof (Segment));
+        segment_ = (const Segment*)mapped;
+        inode_ = status.st_ino;
+        last_sequence_ = segment_->sequence;
+      }
+    }
+    close(fd);
+  }
+
+  Reader(const Reader&);
+  Reader& operator=(const Reader&);
+};
+
+//Driver side. Writers in one process are serialized with a single try-lock,
+//never a spin: the speed loop, poll thread and service threads share it at
+//different realtime priorities, and a writer waiting on a preempted holder on
+//the same CPU would never let it run. A write that finds the lock taken is
+//skipped and counted, the next sample of that kind replacing it anyway.
+class Writer
+{
+public:
+  explicit Writer(const std::string &name) :
+    name_(name), segment_(NULL), lock_(0), skipped_(0)
+  {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      return;
+    if (ftruncate(fd, sizeof (Segment)) == 0)
+    {
+      void* mapped = mmap(NULL, sizeof (Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mapped != MAP_FAILED)
+        segment_ = (Segment*)mapped;
+    }
+    close(fd);
+    if (!segment_)
+      return;
+
+    memset(segment_, 0, sizeof (Segment));
+    segment_->frame.version = FRAME_VERSION;
+    __sync_synchronize();
+    segment_->frame.magic = FRAME_MAGIC;
+  }
+
+  ~Writer()
+  {
+    if (!segment_)
+      return;
+    munmap(segment_, sizeof (Segment));
+    shm_unlink(name_.c_str());
+  }
+
+  bool ok() const
+  {
+    return segment_ != NULL;
+  }
+
+  //Writes skipped because another thread was writing
+  uint64_t skipped() const
+  {
+    return __sync_add_and_fetch(const_cast<volatile uint64_t*>(&skipped_), 0);
+  }
+
+  void writePing(uint64_t stamp, const uint16_t* values, uint32_t count)
+  {
+    if (!begin())
+      return;
+    count = count < 10 ? count : 10;
+    segment_->frame.ping_stamp = stamp;
+    segment_->frame.ping_count = count;
+    memcpy(segment_->frame.ping, values, count * sizeof (uint16_t));
+    end();
+  }
+
+  void writeAdc(uint64_t stamp, const uint16_t* values, uint32_t count)
+  {
+    if (!begin())
+      return;
+    count = count < 8 ? count : 8;
+    segment_->frame.adc_stamp = stamp;
+    segment_->frame.adc_count = count;
+    memcpy(segment_->frame.adc, values, count * sizeof (uint16_t));
+    end();
+  }
+
+  void writeEncoders(uint64_t stamp, int32_t left, int32_t right)
+  {
+    if (!begin())
+      return;
+    segment_->frame.encoder_stamp = stamp;
+    segment_->frame.left_ticks = left;
+    segment_->frame.right_ticks = right;
+    end();
+  }
+
+  void writeHeading(uint64_t stamp, uint16_t heading)
+  {
+    if (!begin())
+      return;
+    segment_->frame.heading_stamp = stamp;
+    segment_->frame.heading = heading;
+    end();
+  }
+
+  void writeSpeed(uint64_t stamp, int16_t left, int16_t right)
+  {
+    if (!begin())
+      return;
+    segment_->frame.speed_stamp = stamp;
+    segment_->frame.left_speed = left;
+    segment_->frame.right_speed = right;
+    end();
+  }
+
+private:
+  std::string name_;
+  Segment* segment_;
+  volatile int lock_;
+  volatile uint64_t skipped_;
+
+  bool begin()
+  {
+    if (!segment_)
+      return false;
+    if (__sync_lock_test_and_set(&lock_, 1))
+    {
+      __sync_fetch_and_add(&skipped_, 1);
+      return false;
+    }
+    segment_->sequence++;
+    __sync_synchronize();
+    return true;
+  }
+
+  void end()
+  {
+    segment_->frame.updates++;
+    __sync_synchronize();
+    segment_->sequence++;
+    __sync_lock_release(&lock_);
+  }
+
+  Writer(const Writer&);
+  Writer& operator=(const Writer&);
+};
+
+}
+
+#endif	/* _EDDIE_SHM_H */
@@ -0,0 +1,86 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_SIM_H
+#define	_EDDIE_SIM_H
+
+#include <ros/ros.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//==============================================================================//
+// Simulated Parallax Eddie control boards on pseudo terminals. Each board gets //
+// a pty linked at sim_port_prefix + index, answers the firmware commands with  //
+// plausible readings and simple wheel kinematics, and delays responses by the //
+// time they would take at 115200 baud. Used to run the driver against many    //
+// boards without the hardware.                                                //
+//==============================================================================//
+
+class EddieSim
+{
+public:
+  EddieSim();
+  virtual ~EddieSim();
+
+  void spin();
+
+private:
+  struct Board
+  {
+    int fd;
+    std::string link;
+    std::string line;
+    std::string outgoing;
+    ros::WallTime due;
+    double left_speed, right_speed;         //ticks per second
+    double left_distance, right_distance;   //ticks
+    double left_target, right_target;       //ticks, for TRVL and TURN
+    bool positioning;
+    uint32_t gpio_state;
+    ros::WallTime updated;
+  };
+
+  ros::NodeHandle node_handle_;
+  std::vector<Board> boards_;
+  const double BAUD_RATE;
+  const double DEGREES_PER_TICK;
+
+  void openBoard(int index, std::string prefix);
+  void update(Board &board);
+  std::string respond(Board &board, const std::string &line);
+  void reply(Board &board, const std::string &response);
+};
+
+#endif	/* _EDDIE_SIM_H */
@@ -0,0 +1,113 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_TELEMETRY_H
+#define	_EDDIE_TELEMETRY_H
+
+#include <ros/ros.h>
+#include <vector>
+#include <stdint.h>
+#include <parallax_eddie_robot/CompactTelemetry.h>
+
+//==============================================================================//
+// Compact telemetry codec shared by the driver and the decoder node. A frame  //
+// holds the ping, ADC, encoder and heading values of one poll cycle. Each     //
+// value is replaced by its difference from the previous frame (zigzag coded), //
+// and each group of differences is packed with the fewest bits that hold the //
+// largest of them. Sample stamps are sent as microsecond offsets from the     //
+// frame stamp. Keyframes are coded against zeros so a decoder can start, or   //
+// recover from a lost frame, on any of them.                                  //
+//==============================================================================//
+
+namespace eddie_telemetry
+{
+
+struct Frame
+{
+  ros::Time stamp;
+
+  bool has_ping;
+  ros::Time ping_stamp;
+  std::vector<uint16_t> ping;
+
+  bool has_adc;
+  ros::Time adc_stamp;
+  std::vector<uint16_t> adc;
+
+  bool has_encoders;
+  ros::Time encoder_stamp;
+  int32_t left_ticks, right_ticks;
+
+  bool has_heading;
+  ros::Time heading_stamp;
+  uint16_t heading;
+
+  Frame();
+};
+
+class Encoder
+{
+public:
+  //A keyframe is sent every keyframe_interval frames
+  explicit Encoder(int keyframe_interval);
+
+  void encode(const Frame &frame, parallax_eddie_robot::CompactTelemetry &message);
+
+private:
+  int keyframe_interval_;
+  uint32_t sequence_;
+  Frame previous_;
+};
+
+class Decoder
+{
+public:
+  Decoder();
+
+  //Returns false for frames that cannot be decoded: delta frames following
+  //a lost frame, until the next keyframe
+  bool decode(const parallax_eddie_robot::CompactTelemetry &message, Frame &frame);
+
+  uint32_t lost() const;
+
+private:
+  bool synchronized_;
+  uint32_t next_sequence_;
+  uint32_t lost_;
+  Frame previous_;
+};
+
+}
+
+#endif	/* _EDDIE_TELEMETRY_H */
@@ -0,0 +1,69 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_TELEMETRY_DECODER_H
+#define	_EDDIE_TELEMETRY_DECODER_H
+
+#include <ros/ros.h>
+#include <parallax_eddie_robot/ADC.h>
+#include <parallax_eddie_robot/CompactTelemetry.h>
+#include <parallax_eddie_robot/Ping.h>
+#include <parallax_eddie_robot/WheelOdometry.h>
+#include "eddie_telemetry.h"
+
+//==============================================================================//
+// Operator side of the compact telemetry stream. Rebuilds the driver's Ping   //
+// and ADC messages, plus the encoder and heading readings, under              //
+// output_namespace, where eddie_ping and eddie_adc can be remapped to turn    //
+// them into distances, voltages and battery level as usual.                   //
+//==============================================================================//
+
+class EddieTelemetryDecoder
+{
+public:
+  EddieTelemetryDecoder();
+
+private:
+  ros::NodeHandle node_handle_;
+  ros::Subscriber telemetry_sub_;
+  ros::Publisher ping_pub_;
+  ros::Publisher adc_pub_;
+  ros::Publisher odometry_pub_;
+  eddie_telemetry::Decoder decoder_;
+  uint32_t reported_lost_;
+
+  void telemetryCallback(const parallax_eddie_robot::CompactTelemetry::ConstPtr& message);
+};
+
+#endif	/* _EDDIE_TELEMETRY_DECODER_H */
@@ -40,8 +40,10 @@
 #include <termios.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <parallax_eddie_robot/Velocity.h>
 #include <parallax_eddie_robot/KeyStroke.h>
+#include <parallax_eddie_robot/TraceEvent.h>
 
 #define KEYCODE_U 0x41
 #define KEYCODE_D 0x42
@@ -62,8 +64,16 @@ private:
   ros::NodeHandle node_handle_;
   ros::Publisher velocity_pub_;
   ros::Publisher keystroke_pub_;
+  ros::Publisher trace_pub_;
   float linear_, angular_;
   double l_scale_, a_scale_;
+  double repeat_rate_, release_timeout_;
+  bool trace_enabled_;
+  uint32_t trace_id_;
+
+  bool keyToVelocity(char c);
+  void publishVelocity(ros::Time origin);
+  void trace(const parallax_eddie_robot::Trace &trace, uint8_t stage, ros::Time stamp);
 
 };
 
@@ -0,0 +1,78 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EDDIE_TRACE_H
+#define	_EDDIE_TRACE_H
+
+#include <ros/ros.h>
+#include <map>
+#include <deque>
+#include <vector>
+#include <parallax_eddie_robot/TraceEvent.h>
+
+//==============================================================================//
+// Collects the stage timestamps published on /eddie/trace by the teleop,       //
+// controller and driver nodes (with trace_enabled set) and reports per stage   //
+// latency percentiles, both from the key read and from the previous stage.     //
+// A recorded session is analysed by running this node while playing back a    //
+// bag of /eddie/trace; the stamps travel inside the events.                    //
+//==============================================================================//
+
+class EddieTrace
+{
+public:
+  EddieTrace();
+  void report();
+
+private:
+  struct Trace
+  {
+    ros::Time origin;
+    std::map<uint8_t, ros::Time> stamps;
+  };
+
+  ros::NodeHandle node_handle_;
+  ros::Subscriber trace_sub_;
+  ros::Timer report_timer_;
+  std::map<uint32_t, Trace> traces_;
+  std::deque<uint32_t> history_;
+  int max_traces_;
+  double report_period_;
+
+  void traceCallback(const parallax_eddie_robot::TraceEvent::ConstPtr& message);
+  void reportCallback(const ros::TimerEvent& event);
+  double percentile(std::vector<double> &values, double p);
+};
+
+#endif	/* _EDDIE_TRACE_H */
@@ -33,9 +33,46 @@
  */
 
 #include "eddie.h"
-typedef std::map<std::string, unsigned char[6] > CommandMap;
+#include "eddie_probes.h"
+#include <cmath>
+#include <algorithm>
+#include <sys/resource.h>
+#include <ros/serialization.h>
 
-Eddie::Eddie() :
+using namespace eddie_commands;
+
+namespace
+{
+
+//Response to a drive command refused by the reflex stop
+const char REFLEX_STOP_ERROR[] = "ERROR: REFLEX STOP";
+
+//Board name for file and shared memory names, the topic namespace without
+//slashes, e.g. "eddie" for "/eddie" and "robot1_eddie" for "/robot1/eddie".
+//The root namespace falls back to "eddie".
+std::string boardName(const std::string &topic_namespace)
+{
+  size_t start = topic_namespace.find_first_not_of('/');
+  if (start == std::string::npos)
+    return "eddie";
+  std::string name = topic_namespace.substr(start, topic_namespace.find_last_not_of('/') + 1 - start);
+  std::replace(name.begin(), name.end(), '/', '_');
+  return name;
+}
+
+typedef bool (*ValueDecoder)(const std::string &response, std::vector<int32_t> &values);
+
+//Encodes a batch command as C and picks the decoder of its reply
+template <class C>
+bool prepareBatchCommand(const parallax_eddie_robot::FirmwareCommand &command, Frame &frame, ValueDecoder &decoder)
+{
+  decoder = &decodeValues<C>;
+  return encodeChecked<C>(command.arg1, command.arg2, frame);
+}
+
+}
+
+Eddie::Eddie(EddieIO &io, ros::NodeHandle node_handle, std::string topic_namespace, ros::CallbackQueue* callback_queue) :
   GPIO_COUNT(10),
   ADC_PIN_COUNT(8),
   DIGITAL_PIN_COUNT(10),
@@ -50,156 +87,1426 @@ Eddie::Eddie() :
   TRAVEL_SPEED_MAX_FORWARD(32767),
   TRAVEL_SPEED_MAX_REVERSE(-32767),
   TRAVEL_MAX_SPEED(65535), 
-  RELAY_33V_PIN_NUMBER(17),
+  RELAY_33V_PIN_NUMBER(16),
   RELAY_5V_PIN_NUMBER(17),
   RELAY_12V_PIN_NUMBER(18), 
-  PACKET_TERMINATOR('\r'),
-  PARAMETER_DELIMITER(' '),
   ERROR("ERROR"), 
   DEFAULT_WHEEL_RADIUS(0.0762),
   DEFAULT_TICKS_PER_REVOLUTION(36),
-  GET_VERSION_STRING("VER"), 
-  SET_GPIO_DIRECTION_OUT_STRING("OUT"),
-  SET_GPIO_DIRECTION_IN_STRING("IN"),
-  SET_GPIO_STATE_HIGH_STRING("HIGH"), 
-  SET_GPIO_STATE_LOW_STRING("LOW"),
-  GET_GPIO_STATE_STRING("READ"),
-  GET_ADC_VALUE_STRING("ADC"), 
-  GET_PING_VALUE_STRING("PING"),
-  SET_DRIVE_POWER_STRING("GO"),
-  SET_DRIVE_SPEED_STRING("GOSPD"), 
-  SET_DRIVE_DISTANCE_STRING("TRVL"),
-  SET_STOP_DISTANCE_STRING("STOP"),
-  SET_ROTATE_STRING("TURN"), 
-  GET_CURRENT_SPEED_STRING("SPD"),
-  GET_CURRENT_HEADING_STRING("HEAD"),
-  GET_ENCODER_TICKS_STRING("DIST"), 
-  RESET_ENCODER_TICKS_STRING("RST"),
-  SET_RAMPING_VALUE_STRING("ACC"),
-  FLUSH_BUFFERS_STRING("\r\r\r")
-{
-  sem_init(&mutex, 0, 1);
-  ping_pub_ = node_handle_.advertise<parallax_eddie_robot::Ping > ("/eddie/ping_data", 1);
-  adc_pub_ = node_handle_.advertise<parallax_eddie_robot::ADC > ("/eddie/adc_data", 1);
+  SERIAL_BAUD_RATE(115200),
+  io_(io),
+  channel_(-1),
+  topic_namespace_(topic_namespace),
+  node_handle_(node_handle),
+  service_threads_(4),
+  poll_rate_(10),
+  poll_idle_rate_(1),
+  poll_idle_delay_(5),
+  poll_mode_report_period_(300),
+  poll_woken_(false),
+  speed_loop_engaged_(false),
+  encoder_reset_pending_(false),
+  target_left_speed_(0),
+  target_right_speed_(0),
+  speed_loop_rate_(50),
+  speed_loop_filter_(0.5),
+  path_active_(false),
+  path_id_(0),
+  path_size_(0),
+  wheel_radius_(DEFAULT_WHEEL_RADIUS),
+  wheel_base_(0.39),
+  ticks_per_revolution_(DEFAULT_TICKS_PER_REVOLUTION),
+  path_max_speed_(0.3),
+  path_feedback_rate_(10),
+  path_stall_cycles_(100),
+  path_stall_count_(0),
+  path_best_progress_(0),
+  path_stall_theta_(0),
+  motion_sequence_id_(0),
+  motion_active_(false),
+  motion_started_(false),
+  motion_poll_rate_(50),
+  motion_stall_timeout_(2.0),
+  motion_tick_tolerance_(1),
+  motion_heading_tolerance_(2),
+  motion_settle_cycles_(5),
+  reflex_enabled_(false),
+  reflex_tripped_(false),
+  reflex_blocked_(false),
+  drive_forward_(false),
+  gpio_direction_(0),
+  gpio_direction_known_(0),
+  gpio_output_(0),
+  gpio_output_known_(0),
+  gpio_input_(0),
+  gpio_cache_max_age_(0.1),
+  serial_initial_timeout_(0.08),
+  serial_min_timeout_(0.01),
+  serial_max_timeout_(0.5),
+  serial_retries_(2),
+  serial_retry_backoff_(0.005),
+  serial_retry_backoff_max_(0.05),
+  serial_resync_settle_(0.005),
+  engine_running_(true),
+  serial_pipelining_(true),
+  max_batch_size_(16),
+  trace_enabled_(false),
+  telemetry_report_period_(30),
+  sensor_frame_enabled_(false),
+  sensor_topics_enabled_(true),
+  history_max_extrapolation_(0.2),
+  poll_odometry_(true)
+{
+  memset(&link_stats_, 0, sizeof (link_stats_));
+  memset(&engine_stats_, 0, sizeof (engine_stats_));
+  memset(&poll_modes_, 0, sizeof (poll_modes_));
+  node_handle_.setCallbackQueue(callback_queue ? callback_queue : &callback_queue_);
+  ping_pub_ = node_handle_.advertise<parallax_eddie_robot::Ping > (topic_namespace_ + "/ping_data", 1);
+  adc_pub_ = node_handle_.advertise<parallax_eddie_robot::ADC > (topic_namespace_ + "/adc_data", 1);
+  trace_pub_ = node_handle_.advertise<parallax_eddie_robot::TraceEvent > (topic_namespace_ + "/trace", 100);
+  reflex_pub_ = node_handle_.advertise<parallax_eddie_robot::ReflexStop > (topic_namespace_ + "/reflex_stop", 10);
+  motion_feedback_pub_ = node_handle_.advertise<parallax_eddie_robot::MotionSequenceFeedback > (topic_namespace_ + "/motion_sequence_feedback", 10);
+  path_feedback_pub_ = node_handle_.advertise<parallax_eddie_robot::PathFeedback > (topic_namespace_ + "/path_feedback", 10);
 
   accelerate_srv_ = node_handle_.advertiseService("accelerate", &Eddie::accelerate, this);
+  cancel_motion_sequence_srv_ = node_handle_.advertiseService("cancel_motion_sequence", &Eddie::cancelMotionSequence, this);
+  drive_closed_loop_srv_ = node_handle_.advertiseService("drive_closed_loop", &Eddie::driveClosedLoop, this);
   drive_with_distance_srv_ = node_handle_.advertiseService("drive_with_distance", &Eddie::driveWithDistance, this);
   drive_with_power_srv_ = node_handle_.advertiseService("drive_with_power", &Eddie::driveWithPower, this);
   drive_with_speed_srv_ = node_handle_.advertiseService("drive_with_speed", &Eddie::driveWithSpeed, this);
+  execute_batch_srv_ = node_handle_.advertiseService("execute_batch", &Eddie::executeBatch, this);
+  execute_motion_sequence_srv_ = node_handle_.advertiseService("execute_motion_sequence", &Eddie::executeMotionSequence, this);
+  follow_path_srv_ = node_handle_.advertiseService("follow_path", &Eddie::followPath, this);
   get_distance_srv_ = node_handle_.advertiseService("get_distance", &Eddie::getDistance, this);
+  get_gpio_state_srv_ = node_handle_.advertiseService("get_gpio_state", &Eddie::getGpioState, this);
   get_heading_srv_ = node_handle_.advertiseService("get_heading", &Eddie::getHeading, this);
   get_speed_srv_ = node_handle_.advertiseService("get_speed", &Eddie::GetSpeed, this);
+  get_state_at_srv_ = node_handle_.advertiseService("get_state_at", &Eddie::getStateAtService, this);
   reset_encoder_srv_ = node_handle_.advertiseService("reset_encoder", &Eddie::resetEncoder, this);
   rotate_srv_ = node_handle_.advertiseService("rotate", &Eddie::rotate, this);
+  set_gpio_direction_srv_ = node_handle_.advertiseService("set_gpio_direction", &Eddie::setGpioDirection, this);
+  set_gpio_state_srv_ = node_handle_.advertiseService("set_gpio_state", &Eddie::setGpioState, this);
+  set_relays_srv_ = node_handle_.advertiseService("set_relays", &Eddie::setRelays, this);
   stop_at_distance_srv_ = node_handle_.advertiseService("stop_at_distance", &Eddie::stopAtDistance, this);
 
   std::string port = "/dev/ttyUSB0";
   node_handle_.param<std::string>("serial_port", port, port);
+  node_handle_.param("serial_initial_timeout", serial_initial_timeout_, serial_initial_timeout_);
+  node_handle_.param("serial_min_timeout", serial_min_timeout_, serial_min_timeout_);
+  node_handle_.param("serial_max_timeout", serial_max_timeout_, serial_max_timeout_);
+  node_handle_.param("serial_retries", serial_retries_, serial_retries_);
+  node_handle_.param("serial_retry_backoff", serial_retry_backoff_, serial_retry_backoff_);
+  node_handle_.param("serial_retry_backoff_max", serial_retry_backoff_max_, serial_retry_backoff_max_);
+  node_handle_.param("serial_resync_settle", serial_resync_settle_, serial_resync_settle_);
+  node_handle_.param("serial_pipelining", serial_pipelining_, serial_pipelining_);
+  node_handle_.param("max_batch_size", max_batch_size_, max_batch_size_);
   initialize(port);
+
+  //created before any thread that samples the board is started
+  ros::NodeHandle global_handle;
+  realtime_ = eddie_realtime::readConfig(global_handle);
+  engine_thread_ = boost::thread(&Eddie::engineLoop, this);
+  //the speed loop waits on the engine for its samples, so it may not run below it
+  if (realtime_.enabled)
+    eddie_realtime::configureThread(engine_thread_.native_handle(), realtime_.priority - 1, realtime_.cpus, "serial engine");
+  int history_capacity = 0;
+  node_handle_.param("history_capacity", history_capacity, history_capacity);
+  node_handle_.param("history_max_extrapolation", history_max_extrapolation_, history_max_extrapolation_);
+  if (history_capacity > 0)
+  {
+    encoder_history_.reset(new EddieHistory(history_capacity));
+    heading_history_.reset(new EddieHistory(history_capacity, 360));
+    speed_history_.reset(new EddieHistory(history_capacity));
+  }
+
+  bool telemetry_enabled = false;
+  int keyframe_interval = 20;
+  node_handle_.param("telemetry_enabled", telemetry_enabled, telemetry_enabled);
+  node_handle_.param("telemetry_keyframe_interval", keyframe_interval, keyframe_interval);
+  node_handle_.param("telemetry_report_period", telemetry_report_period_, telemetry_report_period_);
+  if (telemetry_enabled)
+  {
+    telemetry_pub_ = node_handle_.advertise<parallax_eddie_robot::CompactTelemetry > (topic_namespace_ + "/telemetry", 10);
+    telemetry_encoder_.reset(new eddie_telemetry::Encoder(keyframe_interval));
+  }
+
+  bool processing_enabled = false;
+  int processing_threads = 2;
+  node_handle_.param("processing_enabled", processing_enabled, processing_enabled);
+  node_handle_.param("processing_threads", processing_threads, processing_threads);
+  if (processing_enabled)
+  {
+    processing_.reset(new EddieProcessing(node_handle_, topic_namespace_, processing_threads));
+    //stages are part of the poll cycle, so the workers share its priority
+    if (realtime_.enabled)
+      processing_->setRealtime(realtime_.priority - 2, realtime_.cpus);
+  }
+
+  node_handle_.param("sensor_frame_enabled", sensor_frame_enabled_, sensor_frame_enabled_);
+  node_handle_.param("sensor_topics_enabled", sensor_topics_enabled_, sensor_topics_enabled_);
+  if (sensor_frame_enabled_)
+    sensor_frame_pub_ = node_handle_.advertise<parallax_eddie_robot::SensorFrame > (topic_namespace_ + "/sensor_frame", 10);
+
+  bool shm_enabled = false;
+  node_handle_.param("shm_enabled", shm_enabled, shm_enabled);
+  if (shm_enabled)
+  {
+    std::string name = eddie_shm::segmentName(boardName(topic_namespace_));
+    shm_.reset(new eddie_shm::Writer(name));
+    if (!shm_->ok())
+      ROS_ERROR("ERROR: Unable to create shared memory segment %s", name.c_str());
+  }
+
+  std::string log_directory;
+  int log_segment_size = 64, log_queue_size = 4096;
+  node_handle_.param<std::string>("telemetry_log_directory", log_directory, log_directory);
+  node_handle_.param("telemetry_log_segment_size", log_segment_size, log_segment_size);
+  node_handle_.param("telemetry_log_queue_size", log_queue_size, log_queue_size);
+  if (!log_directory.empty())
+  {
+    //segments are named after the board, e.g. eddie_ping_<time>_0000.seg
+    std::string prefix = boardName(topic_namespace_);
+    telemetry_log_.reset(new eddie_log::Writer(log_directory, prefix, (size_t)log_segment_size << 20, log_queue_size));
+  }
+
+  node_handle_.param("trace_enabled", trace_enabled_, trace_enabled_);
+  node_handle_.param("gpio_cache_max_age", gpio_cache_max_age_, gpio_cache_max_age_);
+
+  double kf = 1.0, kp = 0.5, ki = 2.0, kd = 0.0;
+  node_handle_.param("speed_loop_rate", speed_loop_rate_, speed_loop_rate_);
+  node_handle_.param("speed_loop_filter", speed_loop_filter_, speed_loop_filter_);
+  node_handle_.param("speed_loop_kf", kf, kf);
+  node_handle_.param("speed_loop_kp", kp, kp);
+  node_handle_.param("speed_loop_ki", ki, ki);
+  node_handle_.param("speed_loop_kd", kd, kd);
+  left_pid_.setGains(kf, kp, ki, kd);
+  right_pid_.setGains(kf, kp, ki, kd);
+  left_pid_.setOutputLimits(MOTOR_POWER_MAX_REVERSE, MOTOR_POWER_MAX_FORWARD);
+  right_pid_.setOutputLimits(MOTOR_POWER_MAX_REVERSE, MOTOR_POWER_MAX_FORWARD);
+
+  double lookahead = 0.3, max_angular = 1.0, max_lateral_accel = 0.2, max_decel = 0.3, goal_tolerance = 0.05;
+  node_handle_.param("wheel_radius", wheel_radius_, wheel_radius_);
+  node_handle_.param("wheel_base", wheel_base_, wheel_base_);
+  node_handle_.param("ticks_per_revolution", ticks_per_revolution_, ticks_per_revolution_);
+  node_handle_.param("path_lookahead", lookahead, lookahead);
+  node_handle_.param("path_max_speed", path_max_speed_, path_max_speed_);
+  node_handle_.param("path_max_angular", max_angular, max_angular);
+  node_handle_.param("path_max_lateral_accel", max_lateral_accel, max_lateral_accel);
+  node_handle_.param("path_max_decel", max_decel, max_decel);
+  node_handle_.param("path_goal_tolerance", goal_tolerance, goal_tolerance);
+  node_handle_.param("path_feedback_rate", path_feedback_rate_, path_feedback_rate_);
+  node_handle_.param("path_stall_cycles", path_stall_cycles_, path_stall_cycles_);
+  path_odometry_.setGeometry(wheel_radius_, ticks_per_revolution_, wheel_base_);
+  pursuit_.setLookahead(lookahead);
+  pursuit_.setLimits(max_angular, max_lateral_accel, max_decel);
+  pursuit_.setGoalTolerance(goal_tolerance);
+  if (speed_loop_rate_ > 0)
+  {
+    speed_loop_thread_ = boost::thread(&Eddie::speedLoop, this);
+    //the serial I/O thread runs at realtime_.priority, those waiting on it below
+    if (realtime_.enabled)
+      eddie_realtime::configureThread(speed_loop_thread_.native_handle(), realtime_.priority - 1, realtime_.cpus, "speed loop");
+  }
+
+  node_handle_.param("motion_poll_rate", motion_poll_rate_, motion_poll_rate_);
+  if (motion_poll_rate_ <= 0)
+  {
+    ROS_ERROR("ERROR: motion_poll_rate must be positive, using 50");
+    motion_poll_rate_ = 50;
+  }
+  node_handle_.param("motion_stall_timeout", motion_stall_timeout_, motion_stall_timeout_);
+  node_handle_.param("motion_tick_tolerance", motion_tick_tolerance_, motion_tick_tolerance_);
+  node_handle_.param("motion_heading_tolerance", motion_heading_tolerance_, motion_heading_tolerance_);
+  node_handle_.param("motion_settle_cycles", motion_settle_cycles_, motion_settle_cycles_);
+  motion_thread_ = boost::thread(&Eddie::motionLoop, this);
+  if (realtime_.enabled)
+    eddie_realtime::configureThread(motion_thread_.native_handle(), realtime_.priority - 3, realtime_.cpus, "motion");
+
+  //per sensor thresholds in millimeters, 0 disables the reflex for a sensor
+  node_handle_.param("reflex_stop_enabled", reflex_enabled_, reflex_enabled_);
+  XmlRpc::XmlRpcValue thresholds;
+  if (node_handle_.getParam("reflex_stop_thresholds", thresholds) &&
+      thresholds.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int i = 0; i < thresholds.size(); i++)
+      reflex_thresholds_.push_back(static_cast<int>(thresholds[i]));
+  }
+  reflex_armed_.assign(reflex_thresholds_.size(), true);
+  if (reflex_enabled_ && reflex_thresholds_.empty())
+  {
+    ROS_WARN("Reflex stop enabled without reflex_stop_thresholds, disabling it");
+    reflex_enabled_ = false;
+  }
+
+  //telemetry_log_odometry is the name poll_odometry had before the history
+  if (node_handle_.getParam("telemetry_log_odometry", poll_odometry_))
+    ROS_WARN("telemetry_log_odometry is deprecated, use poll_odometry instead");
+  node_handle_.param("poll_odometry", poll_odometry_, poll_odometry_);
+  node_handle_.param("poll_rate", poll_rate_, poll_rate_);
+  node_handle_.param("poll_idle_rate", poll_idle_rate_, poll_idle_rate_);
+  node_handle_.param("poll_idle_delay", poll_idle_delay_, poll_idle_delay_);
+  node_handle_.param("poll_mode_report_period", poll_mode_report_period_, poll_mode_report_period_);
+  if (poll_rate_ > 0)
+  {
+    poll_thread_ = boost::thread(&Eddie::pollLoop, this);
+    if (realtime_.enabled)
+      eddie_realtime::configureThread(poll_thread_.native_handle(), realtime_.priority - 2, realtime_.cpus, "poll");
+  }
+  //handlers only wait on the serial engine, so a few threads serve many clients
+  if (!callback_queue)
+  {
+    node_handle_.param("service_threads", service_threads_, service_threads_);
+    spinner_.reset(new ros::AsyncSpinner(std::max(service_threads_, 1), &callback_queue_));
+    spinner_->start();
+  }
 }
 
 Eddie::~Eddie()
 {
-  command("STOP 0");
-  close(tty_fd);
+  if (spinner_)
+    spinner_->stop();
+  poll_thread_.interrupt();
+  speed_loop_thread_.interrupt();
+  motion_thread_.interrupt();
+  poll_thread_.join();
+  speed_loop_thread_.join();
+  motion_thread_.join();
+  command(encode<Stop>(0));
+  {
+    boost::mutex::scoped_lock lock(engine_mutex_);
+    engine_running_ = false;
+    engine_condition_.notify_all();
+  }
+  engine_thread_.join();
+  io_.close(channel_);
+  ROS_INFO("Serial link: %llu commands, %llu timeouts, %llu retries, %llu recoveries (mean %.1f ms, max %.1f ms), %llu failures",
+           (unsigned long long)link_stats_.commands, (unsigned long long)link_stats_.timeouts,
+           (unsigned long long)link_stats_.retries, (unsigned long long)link_stats_.recoveries,
+           link_stats_.recoveries ? link_stats_.total_recovery / link_stats_.recoveries * 1000 : 0,
+           link_stats_.max_recovery * 1000, (unsigned long long)link_stats_.failures);
+  ROS_INFO("Serial engine: %llu commands in %llu passes (largest %u), %llu coalesced, %llu pipelined",
+           (unsigned long long)engine_stats_.submissions, (unsigned long long)engine_stats_.passes,
+           (unsigned)engine_stats_.largest_pass, (unsigned long long)engine_stats_.coalesced,
+           (unsigned long long)engine_stats_.pipelined);
+  if (poll_rate_ > 0)
+    reportPollModes();
+  if (telemetry_log_)
+    ROS_INFO("Telemetry log: %llu samples written, %llu dropped",
+             (unsigned long long)telemetry_log_->written(), (unsigned long long)telemetry_log_->dropped());
+  if (shm_ && shm_->ok())
+    ROS_INFO("Shared memory: %llu writes skipped on contention", (unsigned long long)shm_->skipped());
 }
 
 void Eddie::initialize(std::string port)
 {
-  ROS_INFO("Initializing Parallax board serial port connection");
+  ROS_INFO("Initializing Parallax board serial port connection on %s", port.data());
+  channel_ = io_.open(port);
+  usleep(100000);
+}
 
-  memset(&tio, 0, sizeof (tio));
-  tio.c_iflag = 0;
-  tio.c_oflag = 0;
-  tio.c_cflag = CS8 | CREAD | CLOCAL; // 8n1, see termios.h for more information
-  tio.c_lflag = 0;
-  tio.c_cc[VMIN] = 1;
-  tio.c_cc[VTIME] = 5;
+void Eddie::pollLoop()
+{
+  boost::posix_time::time_duration period = boost::posix_time::microseconds((long)(1000000 / poll_rate_));
+  boost::system_time deadline = boost::get_system_time();
+  eddie_realtime::CycleStats stats("Poll loop", 1 / poll_rate_, realtime_.report_period);
+  uint64_t raw_bytes = 0, compact_bytes = 0, frames = 0;
+  double encode_time = 0;
+  ros::WallTime last_report = ros::WallTime::now();
 
-  tty_fd = open(port.data(), O_RDWR | O_NONBLOCK);
-  cfsetospeed(&tio, B115200); // 115200 baud
-  cfsetispeed(&tio, B115200); // 115200 baud
+  //with an idle rate below poll_rate, polling slows down once the drive has
+  //been left alone and the wheels have been still for poll_idle_delay.
+  //noteDriveCommand() wakes it up before the command goes out, so the reflex
+  //stop is back at full rate by the time the robot moves.
+  bool adaptive = poll_idle_rate_ > 0 && poll_idle_rate_ < poll_rate_;
+  boost::posix_time::time_duration idle_period = adaptive ?
+    boost::posix_time::microseconds((long)(1000000 / poll_idle_rate_)) : period;
+  bool idle = false;
+  ros::WallTime last_motion = ros::WallTime::now();
+  ros::WallTime mode_since = last_motion, last_mode_report = last_motion;
+  uint32_t cycle = 0;
 
-  tcsetattr(tty_fd, TCSANOW, &tio);
-  usleep(100000);
+  try
+  {
+    while (ros::ok())
+    {
+      boost::system_time woke = boost::get_system_time();
+      eddie_telemetry::Frame frame;
+      frame.stamp = ros::Time::now();
+      parallax_eddie_robot::Ping ping_data;
+      parallax_eddie_robot::ADC adc_data;
+      int16_t left_speed = 0, right_speed = 0;
+      bool has_speed = false;
+      bool odometry = poll_odometry_ &&
+        (telemetry_log_ || encoder_history_ || telemetry_encoder_ || processing_ || sensor_frame_enabled_);
+      if (sensor_frame_enabled_)
+      {
+        parallax_eddie_robot::SensorFrame sensors;
+        sensors.cycle = cycle;
+        sampleSensors(odometry || (adaptive && !idle), frame, ping_data, adc_data, sensors);
+        sensor_frame_pub_.publish(sensors);
+        has_speed = sensors.has_speed;
+        left_speed = sensors.left_speed;
+        right_speed = sensors.right_speed;
+      }
+      else
+      {
+        ping_data = publishPingData();
+        adc_data = publishADCData();
+        frame.has_ping = ping_data.status == "SUCCESS";
+        frame.ping_stamp = ping_data.header.stamp;
+        frame.ping = ping_data.value;
+        frame.has_adc = adc_data.status == "SUCCESS";
+        frame.adc_stamp = adc_data.header.stamp;
+        frame.adc = adc_data.value;
+        if (odometry)
+        {
+          frame.has_encoders = getEncoderTicks(frame.left_ticks, frame.right_ticks, &frame.encoder_stamp);
+          frame.has_heading = getHeadingDegrees(frame.heading, &frame.heading_stamp);
+          has_speed = getWheelSpeeds(left_speed, right_speed);
+        }
+        else if (adaptive && !idle)
+          has_speed = getWheelSpeeds(left_speed, right_speed);
+      }
+      cycle++;
+
+      if (processing_)
+        processing_->process(frame);
+
+      if (telemetry_encoder_)
+      {
+        ros::WallTime start = ros::WallTime::now();
+        parallax_eddie_robot::CompactTelemetry message;
+        telemetry_encoder_->encode(frame, message);
+        encode_time += (ros::WallTime::now() - start).toSec();
+        telemetry_pub_.publish(message);
+
+        //compared with the Ping and ADC messages and the odometry readings
+        //that would be sent instead
+        parallax_eddie_robot::WheelOdometry wheel_odometry;
+        raw_bytes += ros::serialization::serializationLength(ping_data) + ros::serialization::serializationLength(adc_data);
+        if (frame.has_encoders || frame.has_heading)
+          raw_bytes += ros::serialization::serializationLength(wheel_odometry);
+        compact_bytes += ros::serialization::serializationLength(message);
+        frames++;
+        if (telemetry_report_period_ > 0 && (ros::WallTime::now() - last_report).toSec() >= telemetry_report_period_)
+        {
+          ROS_INFO("Telemetry: %llu frames, %.1f bytes per frame instead of %.1f (%.1fx), encoding %.1f us per frame",
+                   (unsigned long long)frames, (double)compact_bytes / frames, (double)raw_bytes / frames,
+                   compact_bytes ? (double)raw_bytes / compact_bytes : 0, encode_time / frames * 1e6);
+          raw_bytes = compact_bytes = frames = 0;
+          encode_time = 0;
+          last_report = ros::WallTime::now();
+        }
+      }
+      boost::system_time done = boost::get_system_time();
+      stats.record((woke - deadline).total_microseconds() / 1e6, (done - woke).total_microseconds() / 1e6);
+
+      ros::WallTime now = ros::WallTime::now();
+      poll_modes_.cycles[idle]++;
+      if (adaptive)
+      {
+        if (has_speed && (left_speed != 0 || right_speed != 0))
+          last_motion = now;
+        boost::mutex::scoped_lock lock(poll_mutex_);
+        if (last_drive_command_ > last_motion)
+          last_motion = last_drive_command_;
+        bool stationary = (now - last_motion).toSec() >= poll_idle_delay_;
+        if (stationary != idle)
+        {
+          poll_modes_.seconds[idle] += (now - mode_since).toSec();
+          poll_modes_.transitions++;
+          mode_since = now;
+          idle = stationary;
+          poll_woken_ = false;
+        }
+      }
+      if (poll_mode_report_period_ > 0 && (now - last_mode_report).toSec() >= poll_mode_report_period_)
+      {
+        poll_modes_.seconds[idle] += (now - mode_since).toSec();
+        mode_since = now;
+        reportPollModes();
+        last_mode_report = now;
+      }
+
+      deadline += idle ? idle_period : period;
+      if (deadline < done)
+        deadline = done;
+      if (idle)
+      {
+        boost::mutex::scoped_lock lock(poll_mutex_);
+        while (!poll_woken_ && poll_condition_.timed_wait(lock, deadline));
+        if (poll_woken_)
+          deadline = boost::get_system_time();
+      }
+      else
+        boost::this_thread::sleep(deadline);
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+  poll_modes_.seconds[idle] += (ros::WallTime::now() - mode_since).toSec();
+}
+
+//Called before any drive command is written, so an idle poll loop is back at
+//full rate before the robot moves
+void Eddie::noteDriveCommand()
+{
+  boost::mutex::scoped_lock lock(poll_mutex_);
+  last_drive_command_ = ros::WallTime::now();
+  poll_woken_ = true;
+  poll_condition_.notify_one();
+}
+
+//Time spent polling at full and at idle rate. Only the poll thread, or the
+//destructor once it has stopped, calls this.
+void Eddie::reportPollModes()
+{
+  ROS_INFO("Polling: %.1f s at %.1f Hz (%llu cycles), %.1f s idle at %.1f Hz (%llu cycles), %llu mode changes",
+           poll_modes_.seconds[0], poll_rate_, (unsigned long long)poll_modes_.cycles[0],
+           poll_modes_.seconds[1], poll_idle_rate_, (unsigned long long)poll_modes_.cycles[1],
+           (unsigned long long)poll_modes_.transitions);
+}
+
+//Queues the command for the serial engine and waits for its response
+std::string Eddie::command(const Frame &frame, ros::Time *written_time, ros::Time *sampled_time)
+{
+  if (reflexBlocks(frame))
+    return REFLEX_STOP_ERROR;
+  if (frame.motion)
+    noteDriveCommand();
+  Submission submission;
+  submission.frame = &frame;
+  submission.same = NULL;
+  submission.done = false;
+
+  //the engine holds a pointer to the submission until it is done, so an
+  //interrupted thread still waits for it before unwinding
+  boost::this_thread::disable_interruption no_interruption;
+  boost::mutex::scoped_lock lock(engine_mutex_);
+  engine_queue_.push_back(&submission);
+  engine_condition_.notify_one();
+  while (!submission.done)
+    engine_done_.wait(lock);
+  if (written_time)
+    *written_time = submission.written;
+  if (sampled_time)
+    *sampled_time = submission.sampled;
+  return submission.response;
 }
 
-std::string Eddie::command(std::string str)
+//Queues all the submissions under one hold of the engine mutex, so the engine
+//takes them in the same pass, and waits for every response
+void Eddie::commandAll(std::vector<Submission> &submissions)
 {
-  sem_wait(&mutex);
-  ssize_t written;
-  std::stringstream result("");
-  int count = 0;
-  unsigned char c;
-  int size = str.size() + 1;
-  unsigned char command[size];
+  boost::this_thread::disable_interruption no_interruption;
+  boost::mutex::scoped_lock lock(engine_mutex_);
+  for (size_t i = 0; i < submissions.size(); i++)
+  {
+    if (submissions[i].frame->motion)
+      noteDriveCommand();
+    submissions[i].same = NULL;
+    submissions[i].done = false;
+    engine_queue_.push_back(&submissions[i]);
+  }
+  engine_condition_.notify_one();
+  for (size_t i = 0; i < submissions.size(); i++)
+  {
+    while (!submissions[i].done)
+      engine_done_.wait(lock);
+  }
+}
 
-  for (int i = 0; i < size - 1; i++)
+void Eddie::engineLoop()
+{
+  std::vector<Submission*> pass;
+  while (true)
   {
-    command[i] = str[i];
+    {
+      boost::mutex::scoped_lock lock(engine_mutex_);
+      while (engine_running_ && engine_queue_.empty())
+        engine_condition_.wait(lock);
+      if (engine_queue_.empty())
+        return;
+      pass.swap(engine_queue_);
+    }
+
+    mutex.lock();
+    EDDIE_PROBE_CLOCK(serial__pass, start);
+    size_t sent = runPass(pass);
+    EDDIE_PROBE3(serial__pass, pass.size(), sent, EDDIE_PROBE_SINCE(start));
+    mutex.unlock();
+
+    boost::mutex::scoped_lock lock(engine_mutex_);
+    for (size_t i = 0; i < pass.size(); i++)
+    {
+      Submission *submission = pass[i];
+      if (submission->same)
+      {
+        submission->response = submission->same->response;
+        submission->written = submission->same->written;
+        submission->sampled = submission->same->sampled;
+      }
+      submission->done = true;
+    }
+    engine_done_.notify_all();
+    pass.clear();
   }
-  command[size - 1] = PACKET_TERMINATOR; // Having exces terminator is okay, it's good to guarantee
+}
 
-  written = write(tty_fd, command, size);
-  while(read(tty_fd, &c, 1) <= 0){
-    usleep(1000);
-    count++;
-    if(count>=80)
+//Sends the submissions of one pass in order, returns how many commands were
+//sent once identical queries were merged. Callers must hold the serial mutex.
+size_t Eddie::runPass(std::vector<Submission*> &pass)
+{
+  //a query shares the response of an identical one queued before it, as long
+  //as no command that could change the answer was queued in between
+  std::vector<Submission*> unique;
+  size_t shareable = 0;
+  for (size_t i = 0; i < pass.size(); i++)
+  {
+    const Frame &frame = *pass[i]->frame;
+    if (frame.query)
     {
-      ROS_ERROR("ERROR: NO PARALLAX EDDIE ROBOT IS CONNECTED.");
+      for (size_t j = shareable; j < unique.size() && !pass[i]->same; j++)
+      {
+        if (unique[j]->frame->size == frame.size && memcmp(unique[j]->frame->data, frame.data, frame.size) == 0)
+          pass[i]->same = unique[j];
+      }
+      if (pass[i]->same)
+      {
+        engine_stats_.coalesced++;
+        continue;
+      }
+    }
+    else
+      shareable = unique.size() + 1;
+    unique.push_back(pass[i]);
+  }
+  engine_stats_.submissions += pass.size();
+  engine_stats_.passes++;
+  engine_stats_.largest_pass = std::max(engine_stats_.largest_pass, pass.size());
+
+  if (unique.size() == 1 || !serial_pipelining_)
+  {
+    for (size_t i = 0; i < unique.size(); i++)
+      unique[i]->response = transact(*unique[i]->frame, &unique[i]->written, &unique[i]->sampled);
+    return unique.size();
+  }
+
+  //written back to back, keeping no more than half the firmware's input
+  //buffer in flight; only the first response is a clean round trip sample
+  std::vector<EddieIO::Request> requests(unique.size());
+  for (size_t i = 0; i < unique.size(); i++)
+  {
+    requests[i].data = unique[i]->frame->data;
+    requests[i].size = unique[i]->frame->size;
+    if (unique[i]->frame->motion)
+      drive_forward_ = unique[i]->frame->forward;
+    requests[i].timeout = opcodeRTT(unique[i]->frame->opcode).timeout(0);
+    EDDIE_PROBE2(command__start, unique[i]->frame->opcode, unique[i]->frame->size);
+  }
+  size_t answered = io_.pipeline(channel_, requests, PARALLAX_MAX_BUFFER / 2);
+  for (size_t i = 0; i < answered; i++)
+    EDDIE_PROBE4(command__done, unique[i]->frame->opcode, unique[i]->frame->size, requests[i].response.size(),
+                 (uint64_t)(requests[i].round_trip * 1e9));
+  link_stats_.commands += answered;
+  engine_stats_.pipelined += unique.size();
+  if (answered > 0)
+    opcodeRTT(unique[0]->frame->opcode).update(requests[0].round_trip);
+  if (answered < unique.size())
+  {
+    link_stats_.timeouts++;
+    io_.resync(channel_, FLUSH_BUFFERS, sizeof (FLUSH_BUFFERS) - 1, serial_resync_settle_);
+  }
+
+  for (size_t i = 0; i < unique.size(); i++)
+  {
+    Submission *submission = unique[i];
+    EddieIO::Request &request = requests[i];
+    if (i < answered)
+    {
+      //the firmware started on it once it had answered the previous one
+      ros::Time started = request.written_time;
+      if (i > 0 && requests[i - 1].received_time > started)
+        started = requests[i - 1].received_time;
+      submission->response = request.response;
+      submission->written = request.written_time;
+      submission->sampled = estimateSampleTime(request.size, started, request.response.size(), request.received_time);
+    }
+    else if (request.written_time.isZero() || submission->frame->repeatable)
+    {
+      //left over after the link was resynchronized, sent again one at a time
+      submission->response = transact(*submission->frame, &submission->written, &submission->sampled);
+    }
+    else
+    {
+      link_stats_.commands++;
+      link_stats_.failures++;
+      ROS_ERROR("ERROR: NO PARALLAX EDDIE ROBOT IS CONNECTED. %s timed out", submission->frame->opcode);
+      submission->written = submission->sampled = request.written_time;
+    }
+  }
+  return unique.size();
+}
+
+//Drive commands issued by the speed loop and motion sequences go through here
+//so that they cannot undo a reflex stop before those loops are released
+std::string Eddie::driveCommand(const Frame &frame, ros::Time *written_time)
+{
+  noteDriveCommand();
+  //an interrupt inside the transaction would leave the serial mutex held
+  boost::this_thread::disable_interruption no_interruption;
+  mutex.lock();
+  std::string result;
+  if (reflex_tripped_ || reflexBlocks(frame))
+    result = REFLEX_STOP_ERROR;
+  else
+    result = transact(frame, written_time);
+  mutex.unlock();
+  return result;
+}
+
+//Writes a command and reads back the response up to the packet terminator.
+//Callers must hold the serial mutex.
+std::string Eddie::transact(const Frame &frame, ros::Time *written_time, ros::Time *sampled_time)
+{
+  EddieRTT &rtt = opcodeRTT(frame.opcode);
+  std::string response;
+  ros::Time written, received;
+  double round_trip = 0;
+  ros::WallTime first_timeout;
+  int attempts = frame.repeatable ? serial_retries_ + 1 : 1;
+  int attempt;
+  EDDIE_PROBE2(command__start, frame.opcode, frame.size);
+  EDDIE_PROBE_CLOCK(command__done, start);
+  link_stats_.commands++;
+  if (frame.motion)
+    drive_forward_ = frame.forward;
+  for (attempt = 0; attempt < attempts; attempt++)
+  {
+    if (attempt > 0)
+    {
+      double backoff = std::min(serial_retry_backoff_max_, serial_retry_backoff_ * (1 << std::min(attempt - 1, 8)));
+      usleep((useconds_t)(backoff * 1000000));
+      link_stats_.retries++;
+    }
+    if (io_.transact(channel_, frame.data, frame.size, response, &written, &received, &round_trip,
+                     rtt.timeout(attempt)))
       break;
+
+    //whatever the firmware has half received or half sent is flushed, so
+    //that the next response lines up with its command again
+    if (attempt == 0)
+      first_timeout = ros::WallTime::now();
+    link_stats_.timeouts++;
+    io_.resync(channel_, FLUSH_BUFFERS, sizeof (FLUSH_BUFFERS) - 1, serial_resync_settle_);
+    response.clear();
+  }
+
+  if (attempt == attempts)
+  {
+    link_stats_.failures++;
+    ROS_ERROR("ERROR: NO PARALLAX EDDIE ROBOT IS CONNECTED. %s timed out %d time(s)", frame.opcode, attempts);
+  }
+  else if (attempt == 0)
+  {
+    //only first attempts are sampled, a retried response is ambiguous
+    rtt.update(round_trip);
+  }
+  else
+  {
+    double recovery = (ros::WallTime::now() - first_timeout).toSec();
+    link_stats_.recoveries++;
+    link_stats_.last_recovery = recovery;
+    link_stats_.total_recovery += recovery;
+    link_stats_.max_recovery = std::max(link_stats_.max_recovery, recovery);
+    ROS_WARN("Serial link recovered: %s answered after %d retries, %.1f ms after the first timeout (%llu recoveries, %llu failures)",
+             frame.opcode, attempt, recovery * 1000, (unsigned long long)link_stats_.recoveries,
+             (unsigned long long)link_stats_.failures);
+  }
+
+  if (written_time)
+    *written_time = written;
+  if (sampled_time)
+    *sampled_time = response.empty() ? written : estimateSampleTime(frame.size, written, response.size(), received);
+  EDDIE_PROBE4(command__done, frame.opcode, frame.size, response.size(), EDDIE_PROBE_SINCE(start));
+  return response;
+}
+
+//Round trip estimator of an opcode, created on first use. Callers must hold
+//the serial mutex.
+EddieRTT& Eddie::opcodeRTT(const char* opcode)
+{
+  //keyed by the opcode literal of the command table, so the lookup does not allocate
+  std::map<const char*, EddieRTT>::iterator rtt = rtt_.find(opcode);
+  if (rtt == rtt_.end())
+  {
+    rtt = rtt_.insert(std::make_pair(opcode, EddieRTT())).first;
+    rtt->second.setLimits(serial_initial_timeout_, serial_min_timeout_, serial_max_timeout_);
+  }
+  return rtt->second;
+}
+
+//The firmware samples its sensors between reading the last byte of the
+//command and writing the first byte of the response. Both transfers take a
+//known time on the wire, so what remains of the round trip is the firmware's
+//own processing, and the sample is taken to be in the middle of it.
+ros::Time Eddie::estimateSampleTime(size_t command_size, ros::Time written, size_t response_size, ros::Time received)
+{
+  double byte_time = 10.0 / SERIAL_BAUD_RATE;
+  ros::Time command_end = written + ros::Duration(command_size * byte_time);
+  ros::Time response_start = received - ros::Duration(response_size * byte_time);
+  if (response_start <= command_end)
+    return command_end;
+  return command_end + ros::Duration((response_start - command_end).toSec() / 2);
+}
+
+//Same as command(), recording when the command hit the wire and when the
+//response came back for the trace carried by the request
+std::string Eddie::tracedCommand(const Frame &frame, const parallax_eddie_robot::Trace &trace)
+{
+  ros::Time written;
+  std::string result = command(frame, &written);
+  traceEvent(trace, parallax_eddie_robot::TraceEvent::SERIAL_WRITE, written);
+  traceEvent(trace, parallax_eddie_robot::TraceEvent::SERIAL_RESPONSE, ros::Time::now());
+  return result;
+}
+
+void Eddie::traceEvent(const parallax_eddie_robot::Trace &trace, uint8_t stage, ros::Time stamp)
+{
+  if (!trace_enabled_ || trace.id == 0)
+    return;
+  parallax_eddie_robot::TraceEvent event;
+  event.trace = trace;
+  event.stage = stage;
+  event.stamp = stamp;
+  trace_pub_.publish(event);
+}
+
+bool Eddie::getEncoderTicks(int32_t &left, int32_t &right, ros::Time *stamp)
+{
+  ros::Time sampled;
+  if (!recordEncoderTicks(command(encode<Dist>(), NULL, &sampled), sampled, left, right))
+    return false;
+  if (stamp)
+    *stamp = sampled;
+  return true;
+}
+
+//Both in one pass of the serial engine, pipelined back to back. has_heading
+//is false when only the HEAD query failed.
+bool Eddie::getEncoderTicksAndHeading(int32_t &left, int32_t &right, ros::Time *stamp, bool &has_heading,
+  uint16_t &heading)
+{
+  Frame queries[2] = { encode<Dist>(), encode<Head>() };
+  std::vector<Submission> submissions(2);
+  submissions[0].frame = &queries[0];
+  submissions[1].frame = &queries[1];
+  commandAll(submissions);
+  if (!recordEncoderTicks(submissions[0].response, submissions[0].sampled, left, right))
+    return false;
+  if (stamp)
+    *stamp = submissions[0].sampled;
+  has_heading = recordHeadingDegrees(submissions[1].response, submissions[1].sampled, heading);
+  return true;
+}
+
+//Decodes a DIST response and adds it to the history, shared memory and log
+bool Eddie::recordEncoderTicks(const std::string &response, ros::Time sampled, int32_t &left, int32_t &right)
+{
+  int32_t ticks[Dist::Reply::COUNT];
+  if (decode<Dist>(response, ticks) < 0)
+    return false;
+  left = ticks[0];
+  right = ticks[1];
+  if (encoder_history_)
+    encoder_history_->record(sampled, left, right);
+  if (shm_)
+    shm_->writeEncoders(sampled.toNSec(), left, right);
+  logSample(eddie_log::ENCODER, sampled, ticks, Dist::Reply::COUNT);
+  return true;
+}
+
+//Samples the encoders at speed_loop_rate_ and regulates GO power so that each
+//wheel turns at the requested tick rate. Deadlines are absolute, so jitter in
+//one cycle does not accumulate; if a cycle overruns by a full period the
+//missed deadlines are dropped instead of being run back to back. The
+//integration step always uses the measured interval between encoder samples.
+void Eddie::speedLoop()
+{
+  //on the monotonic clock, so that setting the wall clock neither stalls the
+  //loop nor makes it race through the cycles it thinks it missed
+  double period = 1 / speed_loop_rate_;
+  double deadline = eddie_realtime::monotonicNow();
+  ros::Time last_sample_time;
+  int32_t last_left = 0, last_right = 0;
+  double left_speed = 0, right_speed = 0;
+  int last_left_power = 0, last_right_power = 0;
+  bool sampled = false;
+  eddie_realtime::CycleStats stats("Speed loop", 1 / speed_loop_rate_, realtime_.report_period);
+  double woke = 0;
+  bool woken = false;
+
+  try
+  {
+    while (ros::ok())
+    {
+      //the previous cycle's work ends here, whichever way it finished
+      double now = eddie_realtime::monotonicNow();
+      if (woken)
+        stats.record(woke - deadline, now - woke);
+
+      //while disengaged the loop sleeps until a drive or path engages it,
+      //rather than waking at speed_loop_rate for nothing
+      {
+        boost::mutex::scoped_lock lock(speed_loop_mutex_);
+        if (!speed_loop_engaged_)
+        {
+          sampled = false;
+          woken = false;
+          while (!speed_loop_engaged_)
+            speed_loop_condition_.wait(lock);
+          deadline = now = eddie_realtime::monotonicNow();
+        }
+      }
+
+      deadline += period;
+      if (deadline < now)
+      {
+        ROS_DEBUG("Speed loop overran its period by %ld us", (long)((now - deadline) * 1e6));
+        deadline = now;
+      }
+      eddie_realtime::sleepUntil(deadline);
+      boost::this_thread::interruption_point();
+      woke = eddie_realtime::monotonicNow();
+      woken = true;
+
+      boost::mutex::scoped_lock lock(speed_loop_mutex_);
+      if (!speed_loop_engaged_)
+      {
+        sampled = false;
+        continue;
+      }
+
+      //speeds are taken over the estimated sample instants, so serial jitter
+      //does not show up as a speed error
+      int32_t left, right;
+      ros::Time sample_time;
+      bool has_heading = false;
+      uint16_t heading = 0;
+      //paths steer by the gyro, read in the same pass as the ticks
+      if (path_active_ ? !getEncoderTicksAndHeading(left, right, &sample_time, has_heading, heading) :
+          !getEncoderTicks(left, right, &sample_time))
+      {
+        ROS_ERROR("ERROR: speed loop unable to read encoder ticks");
+        continue;
+      }
+
+      if (!sampled)
+      {
+        //first sample after engaging only establishes the reference
+        left_pid_.reset();
+        right_pid_.reset();
+        left_speed = right_speed = 0;
+        last_left_power = last_right_power = 0;
+      }
+      if (!sampled || encoder_reset_pending_)
+      {
+        //the path pose carries on from the new reference readings
+        path_odometry_.reset(path_odometry_.x(), path_odometry_.y(), path_odometry_.theta());
+        last_left = left;
+        last_right = right;
+        last_sample_time = sample_time;
+        encoder_reset_pending_ = false;
+        sampled = true;
+        continue;
+      }
+
+      double dt = (sample_time - last_sample_time).toSec();
+      if (dt <= 0)
+        continue;
+      if (path_active_ && !trackPath(left, right, has_heading, heading))
+      {
+        //reached the end of the path, or stalled on the way
+        speed_loop_engaged_ = false;
+        std::string cmd_response = driveCommand(encode<Go>(MOTOR_POWER_STOP, MOTOR_POWER_STOP));
+        if (!acknowledged<Go>(cmd_response))
+          ROS_ERROR("ERROR: speed loop unable to stop at the end of the path: %s", cmd_response.data());
+        continue;
+      }
+      //36 ticks per revolution quantize heavily at high loop rates, smooth the estimate
+      left_speed = speed_loop_filter_ * left_speed + (1 - speed_loop_filter_) * (left - last_left) / dt;
+      right_speed = speed_loop_filter_ * right_speed + (1 - speed_loop_filter_) * (right - last_right) / dt;
+      last_left = left;
+      last_right = right;
+      last_sample_time = sample_time;
+
+      int left_power = (int)floor(left_pid_.update(target_left_speed_, left_speed, dt) + 0.5);
+      int right_power = (int)floor(right_pid_.update(target_right_speed_, right_speed, dt) + 0.5);
+      if (left_power != last_left_power || right_power != last_right_power)
+      {
+        //the cycle runs under speed_loop_mutex_, so a drive service disengaging
+        //the loop is guaranteed to have its own command go out after this one
+        ros::Time written;
+        std::string cmd_response = driveCommand(encode<Go>(left_power, right_power), &written);
+        //the first power change after a new target completes its trace
+        traceEvent(speed_loop_trace_, parallax_eddie_robot::TraceEvent::SERIAL_WRITE, written);
+        traceEvent(speed_loop_trace_, parallax_eddie_robot::TraceEvent::SERIAL_RESPONSE, ros::Time::now());
+        speed_loop_trace_ = parallax_eddie_robot::Trace();
+        if (acknowledged<Go>(cmd_response))
+        {
+          last_left_power = left_power;
+          last_right_power = right_power;
+        }
+        else if (cmd_response == REFLEX_STOP_ERROR)
+        {
+          //driving into an obstacle the reflex stop still sees, let go
+          ROS_WARN("Speed loop released by the reflex stop");
+          speed_loop_engaged_ = false;
+          if (path_active_)
+            finishPath("ABORTED");
+        }
+        else
+          ROS_ERROR("ERROR: speed loop unable to set drive power: %s", cmd_response.data());
+      }
     }
   }
-  if(count<80){
-    result << c;
-    count = 0;
-    while(c != '\r'){
-      if(read(tty_fd, &c, 1)>0)
-        result << c;
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+void Eddie::disengageSpeedLoop()
+{
+  boost::mutex::scoped_lock lock(speed_loop_mutex_);
+  speed_loop_engaged_ = false;
+  if (path_active_)
+    finishPath("PREEMPTED");
+}
+
+//Advances the path pose to the wheel ticks and gyro heading of this cycle
+//and sets the wheel speed targets the tracker asks for. Returns false once the
+//path is complete or has stalled. Called by the speed loop with
+//speed_loop_mutex_ held.
+bool Eddie::trackPath(int32_t left_ticks, int32_t right_ticks, bool has_heading, uint16_t heading)
+{
+  path_odometry_.update(left_ticks, right_ticks, has_heading, heading * M_PI / 180);
+  double x = path_odometry_.x(), y = path_odometry_.y(), theta = path_odometry_.theta();
+
+  double linear, angular;
+  if (!pursuit_.update(x, y, theta, linear, angular))
+  {
+    target_left_speed_ = target_right_speed_ = 0;
+    finishPath("SUCCEEDED");
+    return false;
+  }
+
+  //turning in place towards the path counts as progress too
+  if (pursuit_.progress() > path_best_progress_ || fabs(remainder(theta - path_stall_theta_, 2 * M_PI)) > 0.1)
+  {
+    path_best_progress_ = pursuit_.progress();
+    path_stall_theta_ = theta;
+    path_stall_count_ = 0;
+  }
+  else if (path_stall_cycles_ > 0 && ++path_stall_count_ >= path_stall_cycles_)
+  {
+    ROS_WARN("Path %u stalled: no progress in %d cycles at %.0f%%", path_id_, path_stall_count_,
+             pursuit_.progress() * 100);
+    target_left_speed_ = target_right_speed_ = 0;
+    finishPath("STALLED");
+    return false;
+  }
+
+  double meters_per_tick = 2 * M_PI * wheel_radius_ / ticks_per_revolution_;
+  double left_speed = (linear - angular * wheel_base_ / 2) / meters_per_tick;
+  double right_speed = (linear + angular * wheel_base_ / 2) / meters_per_tick;
+  target_left_speed_ = (int16_t)std::max(-32767.0, std::min(32767.0, floor(left_speed + 0.5)));
+  target_right_speed_ = (int16_t)std::max(-32767.0, std::min(32767.0, floor(right_speed + 0.5)));
+
+  ros::WallTime now = ros::WallTime::now();
+  if (path_feedback_rate_ > 0 && (now - path_feedback_time_).toSec() >= 1 / path_feedback_rate_)
+  {
+    publishPathFeedback("ACTIVE");
+    path_feedback_time_ = now;
+  }
+  return true;
+}
+
+void Eddie::publishPathFeedback(std::string status)
+{
+  parallax_eddie_robot::PathFeedback feedback;
+  feedback.path_id = path_id_;
+  feedback.index = pursuit_.index();
+  feedback.count = path_size_;
+  feedback.progress = pursuit_.progress();
+  feedback.cross_track_error = pursuit_.crossTrackError();
+  feedback.status = status;
+  path_feedback_pub_.publish(feedback);
+}
+
+//Callers hold speed_loop_mutex_
+void Eddie::finishPath(std::string status)
+{
+  publishPathFeedback(status);
+  path_active_ = false;
+}
+
+bool Eddie::getHeadingDegrees(uint16_t &heading, ros::Time *stamp)
+{
+  ros::Time sampled;
+  if (!recordHeadingDegrees(command(encode<Head>(), NULL, &sampled), sampled, heading))
+    return false;
+  if (stamp)
+    *stamp = sampled;
+  return true;
+}
+
+bool Eddie::recordHeadingDegrees(const std::string &response, ros::Time sampled, uint16_t &heading)
+{
+  uint16_t value[Head::Reply::COUNT];
+  if (decode<Head>(response, value) < 0)
+    return false;
+  heading = value[0];
+  if (heading_history_)
+    heading_history_->record(sampled, heading);
+  if (shm_)
+    shm_->writeHeading(sampled.toNSec(), heading);
+  int32_t logged = heading;
+  logSample(eddie_log::HEADING, sampled, &logged, 1);
+  return true;
+}
+
+bool Eddie::getWheelSpeeds(int16_t &left, int16_t &right, ros::Time *stamp)
+{
+  ros::Time sampled;
+  if (!recordWheelSpeeds(command(encode<Spd>(), NULL, &sampled), sampled, left, right))
+    return false;
+  if (stamp)
+    *stamp = sampled;
+  return true;
+}
+
+bool Eddie::recordWheelSpeeds(const std::string &response, ros::Time sampled, int16_t &left, int16_t &right)
+{
+  int16_t speed[Spd::Reply::COUNT];
+  if (decode<Spd>(response, speed) < 0)
+    return false;
+  left = speed[0];
+  right = speed[1];
+  if (speed_history_)
+    speed_history_->record(sampled, left, right);
+  if (shm_)
+    shm_->writeSpeed(sampled.toNSec(), left, right);
+  int32_t logged[Spd::Reply::COUNT] = { left, right };
+  logSample(eddie_log::SPEED, sampled, logged, Spd::Reply::COUNT);
+  return true;
+}
+
+bool Eddie::getStateAt(ros::Time stamp, parallax_eddie_robot::GetStateAt::Response &state) const
+{
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  state.valid = state.has_heading = state.has_speed = false;
+  if (!encoder_history_ || !encoder_history_->query(stamp, history_max_extrapolation_, values, extrapolated))
+    return false;
+  state.valid = true;
+  state.extrapolated = extrapolated;
+  state.left_ticks = values[0];
+  state.right_ticks = values[1];
+
+  if (heading_history_->query(stamp, history_max_extrapolation_, values, extrapolated))
+  {
+    state.has_heading = true;
+    state.heading = values[0];
+  }
+  if (speed_history_->query(stamp, history_max_extrapolation_, values, extrapolated))
+  {
+    state.has_speed = true;
+    state.left_speed = values[0];
+    state.right_speed = values[1];
+  }
+  return true;
+}
+
+//Queues a sample for the telemetry log, never waits on the writer
+void Eddie::logSample(eddie_log::Stream stream, ros::Time stamp, const int32_t* values, int count)
+{
+  if (!telemetry_log_)
+    return;
+  eddie_log::Sample sample;
+  sample.stream = stream;
+  sample.stamp = stamp.toNSec();
+  memset(sample.value, 0, sizeof (sample.value));
+  memcpy(sample.value, values, std::min(count, eddie_log::MAX_FIELDS) * sizeof (int32_t));
+  telemetry_log_->record(sample);
+}
+
+void Eddie::logSample(eddie_log::Stream stream, ros::Time stamp, const std::vector<uint16_t> &values)
+{
+  int32_t converted[eddie_log::MAX_FIELDS];
+  int count = std::min((int)values.size(), eddie_log::MAX_FIELDS);
+  for (int i = 0; i < count; i++)
+    converted[i] = values[i];
+  logSample(stream, stamp, converted, count);
+}
+
+//Executes the queued motion primitives back to back. Each primitive is
+//started as soon as the previous one is seen to complete, either by reaching
+//its target within tolerance or by the wheels settling. Runs with
+//motion_mutex_ held except while sleeping, so preempting a sequence waits for
+//any firmware command the loop is issuing.
+void Eddie::motionLoop()
+{
+  boost::posix_time::time_duration period = boost::posix_time::microseconds((long)(1000000 / motion_poll_rate_));
+
+  try
+  {
+    boost::mutex::scoped_lock lock(motion_mutex_);
+    while (ros::ok())
+    {
+      while (!motion_active_)
+        motion_condition_.wait(lock);
+
+      if (!motion_started_ && !startMotionPrimitive())
+      {
+        ROS_ERROR("ERROR: unable to start motion primitive %d of sequence %d", (int)motion_index_, motion_sequence_id_);
+        command(encode<Stop>(0));
+        finishMotionSequence("ABORTED");
+        continue;
+      }
+      publishMotionFeedback("ACTIVE");
+
+      lock.unlock();
+      boost::this_thread::sleep(period);
+      lock.lock();
+      //preempted while sleeping, the preempting call has already reported it
+      if (!motion_active_ || !motion_started_)
+        continue;
+
+      bool done = false;
+      if (!pollMotionPrimitive(done))
+      {
+        ROS_ERROR("ERROR: motion primitive %d of sequence %d stalled", (int)motion_index_, motion_sequence_id_);
+        command(encode<Stop>(0));
+        finishMotionSequence("ABORTED");
+        continue;
+      }
+      if (done)
+      {
+        motion_started_ = false;
+        if (++motion_index_ >= motion_sequence_.size())
+          finishMotionSequence("SUCCEEDED");
+      }
     }
   }
-  sem_post(&mutex);
-  return result.str();
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+bool Eddie::startMotionPrimitive()
+{
+  const parallax_eddie_robot::MotionPrimitive &primitive = motion_sequence_[motion_index_];
+  bool ok;
+
+  if (primitive.type == parallax_eddie_robot::MotionPrimitive::ROTATE)
+  {
+    uint16_t heading;
+    if (!getHeadingDegrees(heading))
+      return false;
+    motion_last_heading_ = heading;
+    motion_turned_ = 0;
+    ok = acknowledged<Turn>(driveCommand(encode<Turn>(primitive.value, primitive.speed)));
+  }
+  else
+  {
+    if (!getEncoderTicks(motion_start_left_, motion_start_right_))
+      return false;
+    motion_last_left_ = motion_start_left_;
+    motion_last_right_ = motion_start_right_;
+    if (primitive.type == parallax_eddie_robot::MotionPrimitive::TRAVEL)
+      ok = acknowledged<Trvl>(driveCommand(encode<Trvl>(primitive.value, primitive.speed)));
+    else
+      ok = acknowledged<Stop>(driveCommand(encode<Stop>(primitive.value)));
+  }
+  if (!ok)
+    return false;
+  motion_started_ = true;
+  motion_moved_ = false;
+  motion_settle_count_ = 0;
+  motion_progress_ = 0;
+  motion_start_time_ = ros::WallTime::now();
+  return true;
+}
+
+bool Eddie::pollMotionPrimitive(bool &done)
+{
+  const parallax_eddie_robot::MotionPrimitive &primitive = motion_sequence_[motion_index_];
+  bool changed;
+  int travelled, target, tolerance;
+
+  if (primitive.type == parallax_eddie_robot::MotionPrimitive::ROTATE)
+  {
+    uint16_t heading;
+    if (!getHeadingDegrees(heading))
+      return false;
+    int delta = heading - motion_last_heading_;
+    if (delta > 180)
+      delta -= 360;
+    else if (delta < -180)
+      delta += 360;
+    motion_turned_ += delta;
+    motion_last_heading_ = heading;
+    changed = delta != 0;
+    travelled = abs(motion_turned_);
+    tolerance = motion_heading_tolerance_;
+  }
+  else
+  {
+    int32_t left, right;
+    if (!getEncoderTicks(left, right))
+      return false;
+    changed = left != motion_last_left_ || right != motion_last_right_;
+    motion_last_left_ = left;
+    motion_last_right_ = right;
+    travelled = (abs(left - motion_start_left_) + abs(right - motion_start_right_)) / 2;
+    tolerance = motion_tick_tolerance_;
+  }
+  target = abs(primitive.value);
+
+  if (changed)
+  {
+    motion_moved_ = true;
+    motion_settle_count_ = 0;
+  }
+  else
+    motion_settle_count_++;
+
+  if (primitive.type == parallax_eddie_robot::MotionPrimitive::STOP)
+  {
+    //a stop is complete once the wheels have come to rest
+    done = motion_settle_count_ >= motion_settle_cycles_;
+    motion_progress_ = done ? 1 : 0;
+    return true;
+  }
+
+  motion_progress_ = target > 0 ? std::min(1.0f, (float)travelled / target) : 1;
+  done = travelled + tolerance >= target;
+  if (done)
+    return true;
+  //coming to rest short of the target is a stall too, however far it got
+  if (motion_moved_ && motion_settle_count_ >= motion_settle_cycles_)
+  {
+    ROS_ERROR("ERROR: motion primitive %d of sequence %d came to rest at %d of %d", (int)motion_index_,
+              motion_sequence_id_, travelled, target);
+    return false;
+  }
+  if (!motion_moved_ && (ros::WallTime::now() - motion_start_time_).toSec() > motion_stall_timeout_)
+    return false;
+  return true;
 }
 
-std::string Eddie::generateCommand(std::string str1)
+void Eddie::publishMotionFeedback(std::string status)
 {
-  std::stringstream ss;
-  ss << str1 << PACKET_TERMINATOR;
-  return ss.str();
+  parallax_eddie_robot::MotionSequenceFeedback feedback;
+  feedback.sequence_id = motion_sequence_id_;
+  feedback.index = motion_index_;
+  feedback.count = motion_sequence_.size();
+  feedback.progress = motion_progress_;
+  feedback.status = status;
+  motion_feedback_pub_.publish(feedback);
 }
 
-std::string Eddie::generateCommand(std::string str1, int num1)
+void Eddie::finishMotionSequence(std::string status)
 {
-  std::stringstream ss;
-  ss << str1 << PARAMETER_DELIMITER << intToHexString(num1) << PACKET_TERMINATOR;
-  return ss.str();
+  publishMotionFeedback(status);
+  motion_active_ = false;
+  motion_started_ = false;
 }
 
-std::string Eddie::generateCommand(std::string str1, int num1, int num2)
+void Eddie::preemptMotionSequence()
 {
-  std::stringstream ss;
-  ss << str1 << PARAMETER_DELIMITER << 
-    intToHexString(num1) << PARAMETER_DELIMITER <<
-    intToHexString(num2) << PACKET_TERMINATOR;
-  return ss.str();
+  boost::mutex::scoped_lock lock(motion_mutex_);
+  if (motion_active_)
+    finishMotionSequence("PREEMPTED");
+}
+
+//Called by every drive command so it takes over from the speed loop and any
+//running motion sequence
+void Eddie::releaseDrive()
+{
+  disengageSpeedLoop();
+  preemptMotionSequence();
+}
+
+//Sets the direction of the pins in mask, 1 bits of output become outputs and
+//0 bits inputs. Callers must hold gpio_mutex_.
+bool Eddie::applyGpioDirection(uint32_t mask, uint32_t output)
+{
+  uint32_t to_output = mask & output & ~(gpio_direction_ & gpio_direction_known_);
+  uint32_t to_input = mask & ~output & (gpio_direction_ | ~gpio_direction_known_);
+
+  if (to_output)
+  {
+    if (!acknowledged<Out>(command(encode<Out>(to_output))))
+      return false;
+    gpio_direction_ |= to_output;
+    gpio_direction_known_ |= to_output;
+  }
+  if (to_input)
+  {
+    if (!acknowledged<In>(command(encode<In>(to_input))))
+      return false;
+    gpio_direction_ &= ~to_input;
+    gpio_direction_known_ |= to_input;
+  }
+  return true;
 }
 
-std::string Eddie::intToHexString(int num)
+//Drives the pins in mask to the matching bits of state. Callers must hold
+//gpio_mutex_.
+bool Eddie::applyGpioState(uint32_t mask, uint32_t state)
 {
-  std::stringstream ss;
-  ss << std::hex << num;
-  return ss.str();
+  uint32_t to_high = mask & state & ~(gpio_output_ & gpio_output_known_);
+  uint32_t to_low = mask & ~state & (gpio_output_ | ~gpio_output_known_);
+
+  if (to_high)
+  {
+    if (!acknowledged<High>(command(encode<High>(to_high))))
+      return false;
+    gpio_output_ |= to_high;
+    gpio_output_known_ |= to_high;
+  }
+  if (to_low)
+  {
+    if (!acknowledged<Low>(command(encode<Low>(to_low))))
+      return false;
+    gpio_output_ &= ~to_low;
+    gpio_output_known_ |= to_low;
+  }
+  //output pins read back what they drive, keep the input cache coherent
+  uint32_t outputs = mask & gpio_direction_ & gpio_direction_known_;
+  gpio_input_ = (gpio_input_ & ~outputs) | (state & outputs);
+  return true;
 }
 
 parallax_eddie_robot::Ping Eddie::getPingData()
 {
-  std::string result = command(GET_PING_VALUE_STRING);
+  ros::Time sampled;
+  std::string result = command(encode<Ping>(), NULL, &sampled);
+  return parsePingData(result, sampled);
+}
+
+parallax_eddie_robot::Ping Eddie::parsePingData(std::string result, ros::Time stamp)
+{
   //std::string result = "133 3C9 564 0F9 29B 0F0 31A 566 1E0 A97\r";
+  EDDIE_PROBE_CLOCK(ping__parse, start);
   parallax_eddie_robot::Ping ping_data;
+  ping_data.header.stamp = stamp;
   if (result.size() <= 1)
   {
     ping_data.status = "EMPTY";
+    EDDIE_PROBE4(ping__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
     return ping_data;
   }
   else if (result.size() >= 6)
@@ -207,32 +1514,41 @@ parallax_eddie_robot::Ping Eddie::getPingData()
     if (result.substr(0, 5) == "ERROR")
     {
       ping_data.status = result;
+      EDDIE_PROBE4(ping__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
       return ping_data;
     }
   }
-  ping_data.status = "SUCCESS";
-  std::stringstream value;
-  uint16_t data;
-  for (ushort i = 0; i < result.size(); i += 4)
+  uint16_t values[Ping::Reply::COUNT];
+  int count = decode<Ping>(result, values);
+  if (count < 0)
   {
-    if (result[i] == '\r') break;
-    value << std::hex << result.substr(i, 3);
-    value >> data;
-    ping_data.value.push_back(data);
-    value.str(std::string());
-    value.clear();
+    ping_data.status = "ERROR: MALFORMED RESPONSE";
+    EDDIE_PROBE4(ping__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
+    return ping_data;
   }
+  ping_data.status = "SUCCESS";
+  ping_data.value.assign(values, values + count);
+  EDDIE_PROBE4(ping__parse, count, result.size(), EDDIE_PROBE_SINCE(start), 1);
   return ping_data;
 }
 
 parallax_eddie_robot::ADC Eddie::getADCData()
 {
-  std::string result = command(GET_ADC_VALUE_STRING);
+  ros::Time sampled;
+  std::string result = command(encode<Adc>(), NULL, &sampled);
+  return parseADCData(result, sampled);
+}
+
+parallax_eddie_robot::ADC Eddie::parseADCData(std::string result, ros::Time stamp)
+{
   //std::string result = "9C7 11E E4E 5AB 20F 97B 767 058\r";
+  EDDIE_PROBE_CLOCK(adc__parse, start);
   parallax_eddie_robot::ADC adc_data;
+  adc_data.header.stamp = stamp;
   if (result.size() <= 1)
   {
     adc_data.status = "EMPTY";
+    EDDIE_PROBE4(adc__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
     return adc_data;
   }
   else if (result.size() >= 6)
@@ -240,55 +1556,292 @@ parallax_eddie_robot::ADC Eddie::getADCData()
     if (result.substr(0, 5) == "ERROR")
     {
       adc_data.status = result;
+      EDDIE_PROBE4(adc__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
       return adc_data;
     }
   }
+  uint16_t values[Adc::Reply::COUNT];
+  int count = decode<Adc>(result, values);
+  if (count < 0)
+  {
+    adc_data.status = "ERROR: MALFORMED RESPONSE";
+    EDDIE_PROBE4(adc__parse, 0, result.size(), EDDIE_PROBE_SINCE(start), 0);
+    return adc_data;
+  }
   adc_data.status = "SUCCESS";
-  std::stringstream value;
-  uint16_t data;
-  for (ushort i = 0; i < result.size(); i += 4)
+  adc_data.value.assign(values, values + count);
+  EDDIE_PROBE4(adc__parse, count, result.size(), EDDIE_PROBE_SINCE(start), 1);
+  return adc_data;
+}
+
+parallax_eddie_robot::Ping Eddie::publishPingData()
+{
+  if (!reflex_enabled_)
+  {
+    parallax_eddie_robot::Ping ping_data = getPingData();
+    sendPingData(ping_data);
+    return ping_data;
+  }
+
+  //the frame is checked while the serial mutex is still held, so the STOP is
+  //the very next thing written on the link, ahead of any queued command
+  ros::Time detected, stopped;
+  parallax_eddie_robot::ReflexStop reflex;
+  boost::this_thread::disable_interruption no_interruption;
+  mutex.lock();
+  ros::Time sampled;
+  std::string result = transact(encode<Ping>(), NULL, &sampled);
+  parallax_eddie_robot::Ping ping_data = parsePingData(result, sampled);
+  detected = ros::Time::now();
+  bool fired = checkReflex(ping_data, reflex);
+  if (fired)
+  {
+    reflex_tripped_ = true;
+    transact(encode<Stop>(0), &stopped);
+  }
+  else if (reflex_blocked_ && drive_forward_)
+  {
+    //still in front of the obstacle and possibly driving at it
+    transact(encode<Stop>(0));
+  }
+  mutex.unlock();
+
+  if (fired)
   {
-    if (result[i] == '\r') break;
-    value << std::hex << result.substr(i, 3);
-    value >> data;
-    adc_data.value.push_back(data);
-    value.str(std::string());
-    value.clear();
+    releaseDrive();
+    mutex.lock();
+    reflex_tripped_ = false;
+    mutex.unlock();
+
+    reflex.latency = (stopped - detected).toSec();
+    ROS_WARN("Reflex stop: ping sensor %d at %d mm (threshold %d mm), STOP written %.3f ms after detection",
+             reflex.sensor, reflex.distance, reflex.threshold, reflex.latency * 1000);
+    reflex_pub_.publish(reflex);
+  }
+  sendPingData(ping_data);
+  return ping_data;
+}
+
+//Publishes a ping frame on ping_data, unless only sensor frames go out, and
+//records it when good
+void Eddie::sendPingData(const parallax_eddie_robot::Ping &ping_data)
+{
+  if (sensor_topics_enabled_)
+  {
+    ping_pub_.publish(ping_data);
+    EDDIE_PROBE2(ping__publish, ping_data.value.size(),
+                 EDDIE_PROBE_VALUE(ping__publish, (ros::Time::now() - ping_data.header.stamp).toNSec()));
   }
+  if (ping_data.status == "SUCCESS")
+    recordPingData(ping_data);
+}
+
+//Hands a good ping frame to the telemetry log and the shared memory frame
+void Eddie::recordPingData(const parallax_eddie_robot::Ping &ping_data)
+{
+  logSample(eddie_log::PING, ping_data.header.stamp, ping_data.value);
+  if (shm_ && !ping_data.value.empty())
+    shm_->writePing(ping_data.header.stamp.toNSec(), &ping_data.value[0], ping_data.value.size());
+}
+
+//Fires when a sensor crosses below its threshold. A sensor is re-armed only
+//once its reading is back above the threshold, so the robot can still be
+//driven away from an obstacle that is already close, though not towards it:
+//reflex_blocked_ holds as long as any sensor reads below its threshold.
+bool Eddie::checkReflex(const parallax_eddie_robot::Ping &ping_data, parallax_eddie_robot::ReflexStop &reflex)
+{
+  if (ping_data.status != "SUCCESS")
+    return false;
+
+  bool fired = false, blocked = false;
+  for (size_t i = 0; i < ping_data.value.size() && i < reflex_thresholds_.size(); i++)
+  {
+    if (reflex_thresholds_[i] <= 0 || ping_data.value[i] == 0)
+      continue;
+    if (ping_data.value[i] >= reflex_thresholds_[i])
+    {
+      reflex_armed_[i] = true;
+      continue;
+    }
+    blocked = true;
+    if (reflex_armed_[i])
+    {
+      reflex_armed_[i] = false;
+      if (!fired)
+      {
+        reflex.sensor = i;
+        reflex.distance = ping_data.value[i];
+        reflex.threshold = reflex_thresholds_[i];
+        fired = true;
+      }
+    }
+  }
+  reflex_blocked_ = blocked;
+  return fired;
+}
+
+//True for a forward drive while a sensor with a threshold still reads below
+//it, the sensors given thresholds being the ones facing forward
+bool Eddie::reflexBlocks(const Frame &frame) const
+{
+  return reflex_enabled_ && frame.forward && reflex_blocked_;
+}
+
+parallax_eddie_robot::ADC Eddie::publishADCData()
+{
+  parallax_eddie_robot::ADC adc_data = getADCData();
+  sendADCData(adc_data);
   return adc_data;
 }
 
-void Eddie::publishPingData()
+void Eddie::sendADCData(const parallax_eddie_robot::ADC &adc_data)
 {
-  ping_pub_.publish(getPingData());
+  if (sensor_topics_enabled_)
+  {
+    adc_pub_.publish(adc_data);
+    EDDIE_PROBE2(adc__publish, adc_data.value.size(),
+                 EDDIE_PROBE_VALUE(adc__publish, (ros::Time::now() - adc_data.header.stamp).toNSec()));
+  }
+  if (adc_data.status != "SUCCESS")
+    return;
+  logSample(eddie_log::ADC, adc_data.header.stamp, adc_data.value);
+  if (shm_ && !adc_data.value.empty())
+    shm_->writeAdc(adc_data.header.stamp.toNSec(), &adc_data.value[0], adc_data.value.size());
 }
 
-void Eddie::publishADCData()
+//Samples ping, ADC and, with odometry, encoders, heading and wheel speeds in a
+//single pass of the serial engine. The queries are written back to back, so
+//the whole frame is taken within one round of the link instead of one round
+//trip per sensor. With the reflex stop enabled the ping keeps its own
+//exchange, as the STOP has to follow it directly.
+void Eddie::sampleSensors(bool odometry, eddie_telemetry::Frame &frame, parallax_eddie_robot::Ping &ping_data,
+  parallax_eddie_robot::ADC &adc_data, parallax_eddie_robot::SensorFrame &sensors)
 {
-  adc_pub_.publish(getADCData());
+  enum { PING, ADC, DIST, HEAD, SPD, QUERIES };
+  Frame queries[QUERIES] = { encode<Ping>(), encode<Adc>(), encode<Dist>(), encode<Head>(), encode<Spd>() };
+  int slot[QUERIES];
+  std::vector<Submission> submissions;
+  submissions.reserve(QUERIES);
+  for (int i = 0; i < QUERIES; i++)
+  {
+    slot[i] = -1;
+    if ((i == PING && reflex_enabled_) || (i >= DIST && !odometry))
+      continue;
+    slot[i] = submissions.size();
+    submissions.push_back(Submission());
+    submissions.back().frame = &queries[i];
+  }
+
+  if (reflex_enabled_)
+    ping_data = publishPingData();
+  commandAll(submissions);
+
+  if (slot[PING] >= 0)
+  {
+    ping_data = parsePingData(submissions[slot[PING]].response, submissions[slot[PING]].sampled);
+    sendPingData(ping_data);
+  }
+  adc_data = parseADCData(submissions[slot[ADC]].response, submissions[slot[ADC]].sampled);
+  sendADCData(adc_data);
+  frame.has_ping = ping_data.status == "SUCCESS";
+  frame.ping_stamp = ping_data.header.stamp;
+  frame.ping = sensors.ping = ping_data.value;
+  frame.has_adc = adc_data.status == "SUCCESS";
+  frame.adc_stamp = adc_data.header.stamp;
+  frame.adc = sensors.adc = adc_data.value;
+  sensors.has_ping = frame.has_ping;
+  sensors.has_adc = frame.has_adc;
+
+  ros::Time sampled[QUERIES];
+  bool good[QUERIES] = { frame.has_ping, frame.has_adc, false, false, false };
+  sampled[PING] = ping_data.header.stamp;
+  sampled[ADC] = adc_data.header.stamp;
+  if (odometry)
+  {
+    Submission &dist = submissions[slot[DIST]], &head = submissions[slot[HEAD]], &spd = submissions[slot[SPD]];
+    frame.has_encoders = recordEncoderTicks(dist.response, dist.sampled, frame.left_ticks, frame.right_ticks);
+    frame.encoder_stamp = dist.sampled;
+    frame.has_heading = recordHeadingDegrees(head.response, head.sampled, frame.heading);
+    frame.heading_stamp = head.sampled;
+    sensors.has_encoders = frame.has_encoders;
+    sensors.left_ticks = frame.left_ticks;
+    sensors.right_ticks = frame.right_ticks;
+    sensors.has_heading = frame.has_heading;
+    sensors.heading = frame.heading;
+    sensors.has_speed = recordWheelSpeeds(spd.response, spd.sampled, sensors.left_speed, sensors.right_speed);
+    good[DIST] = frame.has_encoders;
+    good[HEAD] = frame.has_heading;
+    good[SPD] = sensors.has_speed;
+    for (int i = DIST; i < QUERIES; i++)
+      sampled[i] = submissions[slot[i]].sampled;
+  }
+
+  //the frame is stamped with the middle of the span its readings were taken
+  //over, which spread gives
+  ros::Time first, last;
+  for (int i = 0; i < QUERIES; i++)
+  {
+    if (!good[i])
+      continue;
+    if (first.isZero() || sampled[i] < first)
+      first = sampled[i];
+    if (last.isZero() || sampled[i] > last)
+      last = sampled[i];
+  }
+  if (first.isZero())
+    first = last = frame.stamp;
+  sensors.header.stamp = first + ros::Duration((last - first).toSec() / 2);
+  sensors.spread = last - first;
 }
 
 bool Eddie::accelerate(parallax_eddie_robot::Accelerate::Request &req,
   parallax_eddie_robot::Accelerate::Response &res)
 {
   //this feature does not need to validate the parameters due the limited range of parameter data type
-  std::string cmd;
-  cmd = generateCommand(SET_RAMPING_VALUE_STRING, req.rate);
+  Frame cmd = encode<Acc>(req.rate);
   std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  if (acknowledged<Acc>(cmd_response))
     return true;
   else
     return false;
 }
 
+bool Eddie::driveClosedLoop(parallax_eddie_robot::DriveClosedLoop::Request &req,
+  parallax_eddie_robot::DriveClosedLoop::Response &res)
+{
+  traceEvent(req.trace, parallax_eddie_robot::TraceEvent::DRIVER_RECEIVE, ros::Time::now());
+  if (speed_loop_rate_ <= 0)
+  {
+    ROS_ERROR("ERROR: closed-loop drive requested but speed_loop_rate is disabled");
+    return false;
+  }
+  preemptMotionSequence();
+  if (req.left == 0 && req.right == 0)
+  {
+    disengageSpeedLoop();
+    std::string cmd_response = tracedCommand(encode<Go>(MOTOR_POWER_STOP, MOTOR_POWER_STOP), req.trace);
+    return acknowledged<Go>(cmd_response);
+  }
+
+  boost::mutex::scoped_lock lock(speed_loop_mutex_);
+  if (path_active_)
+    finishPath("PREEMPTED");
+  target_left_speed_ = req.left;
+  target_right_speed_ = req.right;
+  speed_loop_trace_ = req.trace;
+  speed_loop_engaged_ = true;
+  speed_loop_condition_.notify_all();
+  return true;
+}
+
 bool Eddie::driveWithDistance(parallax_eddie_robot::DriveWithDistance::Request &req,
   parallax_eddie_robot::DriveWithDistance::Response &res)
 {
+  releaseDrive();
   //this feature does not need to validate the parameters due the limited range of parameter data type
-  std::string cmd;
-  cmd = generateCommand(SET_DRIVE_DISTANCE_STRING, req.distance, req.speed);
+  Frame cmd = encode<Trvl>(req.distance, req.speed);
   std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  if (acknowledged<Trvl>(cmd_response))
     return true;
   else
     return false;
@@ -297,15 +1850,16 @@ bool Eddie::driveWithDistance(parallax_eddie_robot::DriveWithDistance::Request &
 bool Eddie::driveWithPower(parallax_eddie_robot::DriveWithPower::Request &req,
   parallax_eddie_robot::DriveWithPower::Response &res)
 {
+  traceEvent(req.trace, parallax_eddie_robot::TraceEvent::DRIVER_RECEIVE, ros::Time::now());
+  releaseDrive();
   if (req.left > MOTOR_POWER_MAX_FORWARD || req.right > MOTOR_POWER_MAX_FORWARD ||
       req.left < MOTOR_POWER_MAX_REVERSE || req.right < MOTOR_POWER_MAX_REVERSE)
   {
     return false;
   }
-  std::string cmd;
-  cmd = generateCommand(SET_DRIVE_POWER_STRING, req.left, req.right);
-  std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  Frame cmd = encode<Go>(req.left, req.right);
+  std::string cmd_response = tracedCommand(cmd, req.trace);
+  if (acknowledged<Go>(cmd_response))
     return true;
   else{
     ROS_ERROR("%s",cmd_response.data());
@@ -316,82 +1870,339 @@ bool Eddie::driveWithPower(parallax_eddie_robot::DriveWithPower::Request &req,
 bool Eddie::driveWithSpeed(parallax_eddie_robot::DriveWithSpeed::Request &req,
   parallax_eddie_robot::DriveWithSpeed::Response &res)
 {
+  releaseDrive();
   if (req.left > TRAVEL_SPEED_MAX_FORWARD || req.right > TRAVEL_SPEED_MAX_FORWARD ||
       req.left < TRAVEL_SPEED_MAX_REVERSE || req.right < TRAVEL_SPEED_MAX_REVERSE)
   {
     return false;
   }
-  std::string cmd;
-  cmd = generateCommand(SET_DRIVE_SPEED_STRING, req.left, req.right);
+  Frame cmd = encode<GoSpd>(req.left, req.right);
   std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  if (acknowledged<GoSpd>(cmd_response))
     return true;
   else
     return false;
 }
 
-bool Eddie::getDistance(parallax_eddie_robot::GetDistance::Request &req,
-  parallax_eddie_robot::GetDistance::Response &res)
+bool Eddie::executeBatch(parallax_eddie_robot::ExecuteBatch::Request &req,
+  parallax_eddie_robot::ExecuteBatch::Response &res)
 {
-  std::string cmd = GET_ENCODER_TICKS_STRING;
-  std::string cmd_response = command(cmd);
-  if (cmd_response.substr(0, 5) != "ERROR" && cmd_response.size() >= 18)
-  {
-    std::stringstream value;
-    value << std::hex << cmd_response.substr(0, 8);
-    value >> res.left;
-    value.str(std::string());
-    value.clear();
-    value << std::hex << cmd_response.substr(9, 8);
-    value >> res.right;
+  typedef parallax_eddie_robot::FirmwareCommand Command;
+  size_t count = req.commands.size();
+  if (count > (size_t)std::max(max_batch_size_, 1))
+  {
+    res.success = false;
+    res.results.resize(1);
+    res.results[0].error = "ERROR: BATCH TOO LARGE";
     return true;
   }
+  std::vector<Frame> frames(count);
+  std::vector<ValueDecoder> decoders(count);
+  res.results.resize(count);
+  res.success = false;
+
+  //the whole batch is checked before anything is written
+  bool drives = false, resets = false;
+  uint32_t direction_changes = 0, output_changes = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    const Command &cmd = req.commands[i];
+    bool valid = false;
+    switch (cmd.opcode)
+    {
+      case Command::VER: valid = prepareBatchCommand<Ver>(cmd, frames[i], decoders[i]); break;
+      case Command::OUT: valid = prepareBatchCommand<Out>(cmd, frames[i], decoders[i]); break;
+      case Command::IN: valid = prepareBatchCommand<In>(cmd, frames[i], decoders[i]); break;
+      case Command::HIGH: valid = prepareBatchCommand<High>(cmd, frames[i], decoders[i]); break;
+      case Command::LOW: valid = prepareBatchCommand<Low>(cmd, frames[i], decoders[i]); break;
+      case Command::READ: valid = prepareBatchCommand<Read>(cmd, frames[i], decoders[i]); break;
+      case Command::ADC: valid = prepareBatchCommand<Adc>(cmd, frames[i], decoders[i]); break;
+      case Command::PING: valid = prepareBatchCommand<Ping>(cmd, frames[i], decoders[i]); break;
+      case Command::GO: valid = prepareBatchCommand<Go>(cmd, frames[i], decoders[i]); break;
+      case Command::GOSPD: valid = prepareBatchCommand<GoSpd>(cmd, frames[i], decoders[i]); break;
+      case Command::TRVL: valid = prepareBatchCommand<Trvl>(cmd, frames[i], decoders[i]); break;
+      case Command::STOP: valid = prepareBatchCommand<Stop>(cmd, frames[i], decoders[i]); break;
+      case Command::TURN: valid = prepareBatchCommand<Turn>(cmd, frames[i], decoders[i]); break;
+      case Command::SPD: valid = prepareBatchCommand<Spd>(cmd, frames[i], decoders[i]); break;
+      case Command::HEAD: valid = prepareBatchCommand<Head>(cmd, frames[i], decoders[i]); break;
+      case Command::DIST: valid = prepareBatchCommand<Dist>(cmd, frames[i], decoders[i]); break;
+      case Command::RST: valid = prepareBatchCommand<Rst>(cmd, frames[i], decoders[i]); break;
+      case Command::ACC: valid = prepareBatchCommand<Acc>(cmd, frames[i], decoders[i]); break;
+      default:
+        res.results[i].error = "ERROR: UNKNOWN OPCODE";
+        return true;
+    }
+    if (!valid)
+    {
+      res.results[i].error = "ERROR: ARGUMENT OUT OF RANGE";
+      return true;
+    }
+    drives = drives || frames[i].motion;
+    resets = resets || cmd.opcode == Command::RST;
+    if (cmd.opcode == Command::OUT || cmd.opcode == Command::IN)
+      direction_changes |= cmd.arg1;
+    else if (cmd.opcode == Command::HIGH || cmd.opcode == Command::LOW)
+      output_changes |= cmd.arg1;
+  }
+
+  //a batch that drives takes over like any other drive command, one that
+  //resets the encoders keeps the speed loop out like resetEncoder does, and
+  //one that writes GPIO keeps the shadow registers out
+  if (drives)
+  {
+    releaseDrive();
+    noteDriveCommand();
+  }
+  boost::mutex::scoped_lock speed_lock(speed_loop_mutex_, boost::defer_lock);
+  if (resets)
+    speed_lock.lock();
+  boost::mutex::scoped_lock gpio_lock(gpio_mutex_, boost::defer_lock);
+  if (direction_changes || output_changes)
+    gpio_lock.lock();
+
+  mutex.lock();
+  ros::Time start = ros::Time::now();
+  size_t written = 0;
+  bool blocked = drives && reflex_tripped_;
+  for (size_t i = 0; i < count && !blocked; i++)
+    blocked = reflexBlocks(frames[i]);
+  if (blocked)
+  {
+    for (size_t i = 0; i < count; i++)
+      res.results[i].error = REFLEX_STOP_ERROR;
+  }
+  else if (req.stop_on_error)
+  {
+    //each command waits for the one before, and gets the usual retries
+    for (; written < count; written++)
+    {
+      parallax_eddie_robot::FirmwareResult &result = res.results[written];
+      ros::Time sent;
+      std::string response = transact(frames[written], &sent);
+      result.executed = true;
+      result.written = sent - start;
+      result.answered = ros::Time::now() - start;
+      result.success = decoders[written](response, result.values);
+      if (!result.success)
+      {
+        result.error = response.empty() ? "ERROR: NO RESPONSE" : response.substr(0, response.size() - 1);
+        written++;
+        break;
+      }
+    }
+  }
   else
-    return false;
+  {
+    //written back to back, keeping no more than half the firmware's input
+    //buffer in flight; only the first response is a clean round trip sample
+    std::vector<EddieIO::Request> requests(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      requests[i].data = frames[i].data;
+      requests[i].size = frames[i].size;
+      if (frames[i].motion)
+        drive_forward_ = frames[i].forward;
+      requests[i].timeout = opcodeRTT(frames[i].opcode).timeout(0);
+      EDDIE_PROBE2(command__start, frames[i].opcode, frames[i].size);
+    }
+    link_stats_.commands += count;
+    size_t answered = io_.pipeline(channel_, requests, PARALLAX_MAX_BUFFER / 2);
+    for (size_t i = 0; i < answered; i++)
+      EDDIE_PROBE4(command__done, frames[i].opcode, frames[i].size, requests[i].response.size(),
+                   (uint64_t)(requests[i].round_trip * 1e9));
+    if (answered > 0)
+      opcodeRTT(frames[0].opcode).update(requests[0].round_trip);
+    if (answered < count)
+    {
+      link_stats_.timeouts++;
+      link_stats_.failures++;
+      ROS_ERROR("ERROR: batch command %s timed out, %u of %u commands answered",
+                frames[answered].opcode, (unsigned)answered, (unsigned)count);
+      io_.resync(channel_, FLUSH_BUFFERS, sizeof (FLUSH_BUFFERS) - 1, serial_resync_settle_);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      parallax_eddie_robot::FirmwareResult &result = res.results[i];
+      if (requests[i].written_time.isZero())
+        break;
+      written = i + 1;
+      result.executed = true;
+      result.written = requests[i].written_time - start;
+      if (i >= answered)
+      {
+        result.error = "ERROR: NO RESPONSE";
+        continue;
+      }
+      result.answered = requests[i].received_time - start;
+      result.success = decoders[i](requests[i].response, result.values);
+      if (!result.success)
+        result.error = requests[i].response.substr(0, requests[i].response.size() - 1);
+    }
+  }
+  res.elapsed = ros::Time::now() - start;
+  mutex.unlock();
+
+  if (resets)
+    encoder_reset_pending_ = true;
+  //pins touched by the batch are read back from the board next time
+  if (direction_changes || output_changes)
+  {
+    gpio_direction_known_ &= ~direction_changes;
+    gpio_output_known_ &= ~output_changes;
+    gpio_input_stamp_ = ros::Time();
+  }
+
+  res.success = written == count;
+  for (size_t i = written; i < count; i++)
+  {
+    if (res.results[i].error.empty())
+      res.results[i].error = "ERROR: NOT RUN";
+  }
+  for (size_t i = 0; i < written; i++)
+    res.success = res.success && res.results[i].success;
+  return true;
 }
 
-bool Eddie::getHeading(parallax_eddie_robot::GetHeading::Request &req,
-  parallax_eddie_robot::GetHeading::Response &res)
+bool Eddie::executeMotionSequence(parallax_eddie_robot::ExecuteMotionSequence::Request &req,
+  parallax_eddie_robot::ExecuteMotionSequence::Response &res)
 {
-  std::string cmd = GET_CURRENT_HEADING_STRING;
-  std::string cmd_response = command(cmd);
-  if (cmd_response.substr(0, 5) != "ERROR" && cmd_response.size() >= 4)
+  if (req.primitives.empty())
+    return false;
+  for (size_t i = 0; i < req.primitives.size(); i++)
   {
-    std::stringstream value;
-    value << std::hex << cmd_response.substr(0, 3);
-    value >> res.heading;
-    return true;
+    if (req.primitives[i].type > parallax_eddie_robot::MotionPrimitive::STOP)
+      return false;
   }
+
+  disengageSpeedLoop();
+  boost::mutex::scoped_lock lock(motion_mutex_);
+  if (motion_active_)
+    finishMotionSequence("PREEMPTED");
+  motion_sequence_ = req.primitives;
+  motion_sequence_id_++;
+  motion_index_ = 0;
+  motion_progress_ = 0;
+  motion_started_ = false;
+  motion_active_ = true;
+  motion_condition_.notify_one();
+  res.sequence_id = motion_sequence_id_;
+  return true;
+}
+
+bool Eddie::cancelMotionSequence(parallax_eddie_robot::CancelMotionSequence::Request &req,
+  parallax_eddie_robot::CancelMotionSequence::Response &res)
+{
+  preemptMotionSequence();
+  std::string cmd_response = command(encode<Stop>(0));
+  if (acknowledged<Stop>(cmd_response))
+    return true;
   else
     return false;
 }
 
+//Follows the path with the speed loop, from the pose the robot is in now:
+//x ahead and y to the left, in meters. An empty path stops the one being
+//followed.
+bool Eddie::followPath(parallax_eddie_robot::FollowPath::Request &req,
+  parallax_eddie_robot::FollowPath::Response &res)
+{
+  traceEvent(req.trace, parallax_eddie_robot::TraceEvent::DRIVER_RECEIVE, ros::Time::now());
+  if (speed_loop_rate_ <= 0)
+  {
+    ROS_ERROR("ERROR: path following requested but speed_loop_rate is disabled");
+    return false;
+  }
+  preemptMotionSequence();
+  if (req.points.empty())
+  {
+    disengageSpeedLoop();
+    std::string cmd_response = tracedCommand(encode<Go>(MOTOR_POWER_STOP, MOTOR_POWER_STOP), req.trace);
+    return acknowledged<Go>(cmd_response);
+  }
+
+  std::vector<EddiePursuit::Point> path(req.points.size());
+  for (size_t i = 0; i < req.points.size(); i++)
+  {
+    path[i].x = req.points[i].x;
+    path[i].y = req.points[i].y;
+  }
+
+  boost::mutex::scoped_lock lock(speed_loop_mutex_);
+  if (path_active_)
+    finishPath("PREEMPTED");
+  pursuit_.setPath(path);
+  pursuit_.setMaxSpeed(req.speed > 0 ? std::min((double)req.speed, path_max_speed_) : path_max_speed_);
+  path_id_++;
+  path_size_ = path.size();
+  path_odometry_.reset();
+  path_stall_count_ = 0;
+  path_best_progress_ = path_stall_theta_ = 0;
+  path_feedback_time_ = ros::WallTime();
+  path_active_ = true;
+  //the first cycle sets the targets, until then the wheels are held still
+  if (!speed_loop_engaged_)
+    target_left_speed_ = target_right_speed_ = 0;
+  speed_loop_trace_ = req.trace;
+  speed_loop_engaged_ = true;
+  speed_loop_condition_.notify_all();
+  res.path_id = path_id_;
+  return true;
+}
+
+bool Eddie::getDistance(parallax_eddie_robot::GetDistance::Request &req,
+  parallax_eddie_robot::GetDistance::Response &res)
+{
+  return getEncoderTicks(res.left, res.right, &res.stamp);
+}
+
+bool Eddie::getGpioState(parallax_eddie_robot::GetGpioState::Request &req,
+  parallax_eddie_robot::GetGpioState::Response &res)
+{
+  //a negative max_age asks for the configured staleness limit
+  double max_age = req.max_age < 0 ? gpio_cache_max_age_ : req.max_age;
+  boost::mutex::scoped_lock lock(gpio_mutex_);
+  ros::Time now = ros::Time::now();
+  if (gpio_input_stamp_.isZero() || (now - gpio_input_stamp_).toSec() > max_age)
+  {
+    uint32_t state[Read::Reply::COUNT];
+    if (decode<Read>(command(encode<Read>()), state) < 0)
+      return false;
+    gpio_input_ = state[0];
+    gpio_input_stamp_ = ros::Time::now();
+  }
+  res.state = gpio_input_;
+  res.stamp = gpio_input_stamp_;
+  return true;
+}
+
+bool Eddie::getHeading(parallax_eddie_robot::GetHeading::Request &req,
+  parallax_eddie_robot::GetHeading::Response &res)
+{
+  return getHeadingDegrees(res.heading, &res.stamp);
+}
+
 bool Eddie::GetSpeed(parallax_eddie_robot::GetSpeed::Request &req,
   parallax_eddie_robot::GetSpeed::Response &res)
 {
-  std::string cmd = GET_CURRENT_SPEED_STRING;
-  std::string cmd_response = command(cmd);
-  if (cmd_response.substr(0, 5) != "ERROR" && cmd_response.size() >= 10)
-  {
-    std::stringstream value;
-    value << std::hex << cmd_response.substr(0, 4);
-    value >> res.left;
-    value.str(std::string());
-    value.clear();
-    value << std::hex << cmd_response.substr(5, 4);
-    value >> res.right;
-    return true;
-  }
-  else
-    return false;
+  return getWheelSpeeds(res.left, res.right, &res.stamp);
+}
+
+bool Eddie::getStateAtService(parallax_eddie_robot::GetStateAt::Request &req,
+  parallax_eddie_robot::GetStateAt::Response &res)
+{
+  getStateAt(req.stamp, res);
+  return true;
 }
 
 bool Eddie::resetEncoder(parallax_eddie_robot::ResetEncoder::Request &req,
   parallax_eddie_robot::ResetEncoder::Response &res)
 {
-  std::string cmd = RESET_ENCODER_TICKS_STRING;
-  std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  //the speed loop must not difference ticks across a reset
+  boost::mutex::scoped_lock lock(speed_loop_mutex_);
+  std::string cmd_response = command(encode<Rst>());
+  encoder_reset_pending_ = true;
+  if (acknowledged<Rst>(cmd_response))
     return true;
   else
     return false;
@@ -400,22 +2211,60 @@ bool Eddie::resetEncoder(parallax_eddie_robot::ResetEncoder::Request &req,
 bool Eddie::rotate(parallax_eddie_robot::Rotate::Request &req,
   parallax_eddie_robot::Rotate::Response &res)
 {
-  std::string cmd;
-  cmd = generateCommand(SET_ROTATE_STRING, req.angle, req.speed);
-  std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  traceEvent(req.trace, parallax_eddie_robot::TraceEvent::DRIVER_RECEIVE, ros::Time::now());
+  releaseDrive();
+  Frame cmd = encode<Turn>(req.angle, req.speed);
+  std::string cmd_response = tracedCommand(cmd, req.trace);
+  if (acknowledged<Turn>(cmd_response))
     return true;
   else
     return false;
 }
 
+bool Eddie::setGpioDirection(parallax_eddie_robot::SetGpioDirection::Request &req,
+  parallax_eddie_robot::SetGpioDirection::Response &res)
+{
+  if (!fits<Out::Args::First>(req.mask))
+    return false;
+  boost::mutex::scoped_lock lock(gpio_mutex_);
+  return applyGpioDirection(req.mask, req.output);
+}
+
+bool Eddie::setGpioState(parallax_eddie_robot::SetGpioState::Request &req,
+  parallax_eddie_robot::SetGpioState::Response &res)
+{
+  if (!fits<High::Args::First>(req.mask))
+    return false;
+  boost::mutex::scoped_lock lock(gpio_mutex_);
+  return applyGpioState(req.mask, req.state);
+}
+
+bool Eddie::setRelays(parallax_eddie_robot::SetRelays::Request &req,
+  parallax_eddie_robot::SetRelays::Response &res)
+{
+  const unsigned char pins[] = {RELAY_33V_PIN_NUMBER, RELAY_5V_PIN_NUMBER, RELAY_12V_PIN_NUMBER};
+  uint32_t mask = 0, state = 0;
+  for (int i = 0; i < AUXILIARY_POWER_RELAY_COUNT; i++)
+  {
+    if (req.mask & (1 << i))
+    {
+      mask |= 1UL << pins[i];
+      if (req.state & (1 << i))
+        state |= 1UL << pins[i];
+    }
+  }
+  boost::mutex::scoped_lock lock(gpio_mutex_);
+  return applyGpioDirection(mask, mask) && applyGpioState(mask, state);
+}
+
 bool Eddie::stopAtDistance(parallax_eddie_robot::StopAtDistance::Request &req,
   parallax_eddie_robot::StopAtDistance::Response &res)
 {
-  std::string cmd;
-  cmd = generateCommand(SET_STOP_DISTANCE_STRING, req.distance);
-  std::string cmd_response = command(cmd);
-  if (cmd_response == "\r")
+  traceEvent(req.trace, parallax_eddie_robot::TraceEvent::DRIVER_RECEIVE, ros::Time::now());
+  releaseDrive();
+  Frame cmd = encode<Stop>(req.distance);
+  std::string cmd_response = tracedCommand(cmd, req.trace);
+  if (acknowledged<Stop>(cmd_response))
     return true;
   else
     return false;
@@ -425,17 +2274,66 @@ int main(int argc, char** argv)
 {
   ROS_INFO("Parallax Board booting up");
   ros::init(argc, argv, "parallax_board");
-  Eddie eddie; //set port to connect to Paralax controller board
-  ros::Rate loop_rate(10);
+  ros::NodeHandle node_handle;
+  EddieIO io;
+  std::vector<boost::shared_ptr<Eddie> > boards;
+
+  //memory is locked before the boards allocate theirs
+  eddie_realtime::Config realtime = eddie_realtime::readConfig(node_handle);
+  if (realtime.enabled)
+  {
+    eddie_realtime::lockMemory(realtime.heap_prefault);
+    io.setRealtime(realtime.priority, realtime.cpus);
+  }
+
+  //fleet mode: "boards" lists one namespace per board, each with its own
+  //serial_port and other parameters, services and topics under it. The boards
+  //share one callback queue, spun by service_threads threads in all.
+  ros::CallbackQueue callback_queue;
+  boost::scoped_ptr<ros::AsyncSpinner> spinner;
+  XmlRpc::XmlRpcValue names;
+  if (node_handle.getParam("boards", names) && names.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int i = 0; i < names.size(); i++)
+    {
+      std::string name = static_cast<std::string>(names[i]);
+      boards.push_back(boost::shared_ptr<Eddie>(new Eddie(io, ros::NodeHandle(name), "/" + name, &callback_queue)));
+    }
+    int service_threads = 4;
+    node_handle.param("service_threads", service_threads, service_threads);
+    spinner.reset(new ros::AsyncSpinner(std::max(service_threads, 1), &callback_queue));
+    spinner->start();
+  }
+  else
+  {
+    boards.push_back(boost::shared_ptr<Eddie>(new Eddie(io))); //set port to connect to Paralax controller board
+  }
 
+  //report the process CPU use so it can be compared across board counts
+  double cpu_report_period = 0;
+  node_handle.param("cpu_report_period", cpu_report_period, cpu_report_period);
+  struct rusage last_usage;
+  getrusage(RUSAGE_SELF, &last_usage);
+  ros::WallTime last_report = ros::WallTime::now();
   while (ros::ok())
   {
-    eddie.publishPingData();
-    eddie.publishADCData();
+    ros::WallDuration(cpu_report_period > 0 ? cpu_report_period : 0.5).sleep();
+    if (cpu_report_period <= 0)
+      continue;
 
-    ros::spinOnce();
-    loop_rate.sleep();
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    ros::WallTime now = ros::WallTime::now();
+    double cpu = (usage.ru_utime.tv_sec - last_usage.ru_utime.tv_sec) + (usage.ru_stime.tv_sec - last_usage.ru_stime.tv_sec) +
+      ((usage.ru_utime.tv_usec - last_usage.ru_utime.tv_usec) + (usage.ru_stime.tv_usec - last_usage.ru_stime.tv_usec)) / 1e6;
+    ROS_INFO("Serving %d board(s), CPU use %.2f%%", (int)boards.size(), 100 * cpu / (now - last_report).toSec());
+    last_usage = usage;
+    last_report = now;
   }
 
+  //no handler may run on a board once it is being destroyed
+  if (spinner)
+    spinner->stop();
+  boards.clear();
   return 0;
 }
@@ -61,6 +61,7 @@ void EddieADC::adcCallback(const parallax_eddie_robot::ADC::ConstPtr& message)
     return;
   }
 
+  voltages_.header = message->header;
   uint i;
   for (i = 0; i < message->value.size() - 1; i++)
   {
@@ -0,0 +1,185 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_calibrate.h"
+#include <algorithm>
+#include <signal.h>
+#include <parallax_eddie_robot/DriveWithPower.h>
+#include <parallax_eddie_robot/GetDistance.h>
+
+//Set by Ctrl-C. The sweep stops at the next check and the wheels are stopped
+//from the main thread before the node shuts down.
+static volatile sig_atomic_t interrupted = 0;
+
+EddieCalibrate::EddieCalibrate() :
+  power_step_(10), max_power_(120), settle_(1.0), measure_(1.0), file_("eddie_motor_calibration.txt")
+{
+  node_handle_.param("calibration_power_step", power_step_, power_step_);
+  node_handle_.param("calibration_max_power", max_power_, max_power_);
+  node_handle_.param("calibration_settle", settle_, settle_);
+  node_handle_.param("calibration_measure", measure_, measure_);
+  node_handle_.param<std::string>("calibration_file", file_, file_);
+
+  drive_power_ = node_handle_.serviceClient<parallax_eddie_robot::DriveWithPower > ("drive_with_power");
+  get_distance_ = node_handle_.serviceClient<parallax_eddie_robot::GetDistance > ("get_distance");
+}
+
+bool EddieCalibrate::run()
+{
+  if (power_step_ < 1 || max_power_ < power_step_ || max_power_ > 127 || measure_ <= 0)
+  {
+    ROS_ERROR("ERROR: calibration needs 0 < calibration_power_step <= calibration_max_power <= 127 and a positive calibration_measure");
+    return false;
+  }
+  if (!drive_power_.waitForExistence(ros::Duration(10)))
+  {
+    ROS_ERROR("ERROR: the eddie driver is not running");
+    return false;
+  }
+
+  bool ok = true;
+  for (int power = power_step_; ok; power += power_step_)
+  {
+    if (!running())
+    {
+      ok = false;
+      break;
+    }
+    power = std::min(power, max_power_);
+    ok = measure(power) && measure(-power);
+    if (power == max_power_)
+      break;
+  }
+  //the wheels are stopped whatever happened
+  if (!drive(0))
+    ok = false;
+  if (!ok)
+  {
+    if (!running())
+      ROS_WARN("Calibration interrupted");
+    ROS_ERROR("ERROR: calibration aborted, %s was not written", file_.c_str());
+    return false;
+  }
+
+  if (!table_.save(file_))
+  {
+    ROS_ERROR("ERROR: unable to write %s", file_.c_str());
+    return false;
+  }
+  ROS_INFO("Motor calibration: %d power levels written to %s", (int)table_.size(), file_.c_str());
+  return true;
+}
+
+bool EddieCalibrate::drive(int power)
+{
+  parallax_eddie_robot::DriveWithPower drive;
+  drive.request.left = power;
+  drive.request.right = power;
+  if (drive_power_.call(drive))
+    return true;
+  ROS_ERROR("ERROR: unable to drive at power %d", power);
+  return false;
+}
+
+//Speeds come from the driver's estimate of when each DIST was sampled, so
+//the latency of the service calls does not show up in them
+bool EddieCalibrate::measure(int power)
+{
+  if (!drive(power) || !wait(settle_))
+    return false;
+
+  parallax_eddie_robot::GetDistance first, second;
+  if (!get_distance_.call(first))
+  {
+    ROS_ERROR("ERROR: unable to read the encoders at power %d", power);
+    return false;
+  }
+  if (!wait(measure_))
+    return false;
+  if (!get_distance_.call(second))
+  {
+    ROS_ERROR("ERROR: unable to read the encoders at power %d", power);
+    return false;
+  }
+  double elapsed = (second.response.stamp - first.response.stamp).toSec();
+  if (elapsed <= 0)
+  {
+    ROS_ERROR("ERROR: encoder readings at power %d are not in time order", power);
+    return false;
+  }
+
+  double left = (second.response.left - first.response.left) / elapsed;
+  double right = (second.response.right - first.response.right) / elapsed;
+  table_.add(power, left, right);
+  ROS_INFO("Power %4d: left %6.1f, right %6.1f ticks/s", power, left, right);
+  return true;
+}
+
+bool EddieCalibrate::running() const
+{
+  return !interrupted && ros::ok();
+}
+
+//Sleeps in short steps so that Ctrl-C does not leave the wheels turning for
+//the rest of a long measurement. False if interrupted.
+bool EddieCalibrate::wait(double seconds)
+{
+  ros::WallTime end = ros::WallTime::now() + ros::WallDuration(seconds);
+  while (running())
+  {
+    ros::WallDuration left = end - ros::WallTime::now();
+    if (left <= ros::WallDuration(0))
+      return true;
+    std::min(left, ros::WallDuration(0.05)).sleep();
+  }
+  return false;
+}
+
+void interrupt(int sig)
+{
+  interrupted = 1;
+}
+
+int main(int argc, char** argv)
+{
+  //roscpp's own handler would shut the node down before the STOP is sent
+  ros::init(argc, argv, "eddie_calibrate", ros::init_options::NoSigintHandler);
+  EddieCalibrate calibrate;
+
+  signal(SIGINT, interrupt);
+
+  bool ok = calibrate.run();
+  ros::shutdown();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -33,25 +33,285 @@
  */
 
 #include "eddie_controller.h"
+#include "eddie_probes.h"
 
 EddieController::EddieController() :
-  left_power_(60), right_power_(62), rotation_speed_(36)
+  left_power_(60), right_power_(62), rotation_speed_(36), closed_loop_(false), wheel_speed_(40),
+  governor_enabled_(false), governor_stop_distance_(300), governor_slow_distance_(1000),
+  governor_timeout_(0.5), governor_crawl_scale_(0.2), governor_ir_stop_voltage_(0), front_clearance_(-1), rear_clearance_(-1),
+  ir_blocked_(false), last_linear_(0), last_scale_(1), last_angular_(0), path_id_(0), following_path_(false),
+  velocity_stats_("Controller", 0, 0),
+  trace_enabled_(false)
 {
   velocity_sub_ = node_handle_.subscribe("/eddie/command_velocity", 1, &EddieController::velocityCallback, this);
+  path_sub_ = node_handle_.subscribe("/eddie/command_path", 1, &EddieController::pathCallback, this);
+  path_feedback_sub_ = node_handle_.subscribe("/eddie/path_feedback", 10, &EddieController::pathFeedbackCallback, this);
   eddie_drive_power_ = node_handle_.serviceClient<parallax_eddie_robot::DriveWithPower > ("drive_with_power");
+  eddie_drive_closed_loop_ = node_handle_.serviceClient<parallax_eddie_robot::DriveClosedLoop > ("drive_closed_loop");
+  eddie_follow_path_ = node_handle_.serviceClient<parallax_eddie_robot::FollowPath > ("follow_path");
   eddie_turn_ = node_handle_.serviceClient<parallax_eddie_robot::Rotate > ("rotate");
   eddie_stop_ = node_handle_.serviceClient<parallax_eddie_robot::StopAtDistance > ("stop_at_distance");
+  trace_pub_ = node_handle_.advertise<parallax_eddie_robot::TraceEvent > ("/eddie/trace", 100);
 
   node_handle_.param("left_motor_power", left_power_, left_power_);
   node_handle_.param("right_motor_power", right_power_, right_power_);
   node_handle_.param("rotation_speed", rotation_speed_, rotation_speed_);
+  //in closed-loop mode linear is mapped to a wheel speed in encoder ticks per
+  //second, which the driver holds regardless of battery voltage and load
+  node_handle_.param("closed_loop", closed_loop_, closed_loop_);
+  node_handle_.param("wheel_speed", wheel_speed_, wheel_speed_);
+  //a table from eddie_calibrate replaces left_motor_power and right_motor_power
+  std::string calibration_file;
+  node_handle_.param<std::string>("motor_calibration_file", calibration_file, calibration_file);
+  if (!calibration_file.empty())
+  {
+    if (motor_table_.load(calibration_file))
+      ROS_INFO("Motor calibration: %d power levels from %s", (int)motor_table_.size(), calibration_file.c_str());
+    else
+      ROS_ERROR("ERROR: unable to read motor calibration %s, using left_motor_power and right_motor_power",
+                calibration_file.c_str());
+  }
+
+  node_handle_.param("trace_enabled", trace_enabled_, trace_enabled_);
+
+  double deadline = 0.02;
+  realtime_ = eddie_realtime::readConfig(node_handle_);
+  node_handle_.param("controller_deadline", deadline, deadline);
+  velocity_stats_.configure(deadline, realtime_.report_period);
+
+  node_handle_.param("governor_enabled", governor_enabled_, governor_enabled_);
+  node_handle_.param("governor_stop_distance", governor_stop_distance_, governor_stop_distance_);
+  node_handle_.param("governor_slow_distance", governor_slow_distance_, governor_slow_distance_);
+  node_handle_.param("governor_timeout", governor_timeout_, governor_timeout_);
+  node_handle_.param("governor_crawl_scale", governor_crawl_scale_, governor_crawl_scale_);
+  governor_crawl_scale_ = std::max(0.0, std::min(governor_crawl_scale_, 1.0));
+  node_handle_.param("governor_ir_stop_voltage", governor_ir_stop_voltage_, governor_ir_stop_voltage_);
+  front_sensors_.push_back(0);
+  front_sensors_.push_back(1);
+  readSensorList("governor_front_sensors", front_sensors_);
+  readSensorList("governor_rear_sensors", rear_sensors_);
+  if (governor_enabled_)
+  {
+    distances_sub_ = node_handle_.subscribe("/eddie/ping_distances", 1, &EddieController::distancesCallback, this);
+    if (governor_ir_stop_voltage_ > 0)
+      ir_sub_ = node_handle_.subscribe("/eddie/ir_voltages", 1, &EddieController::irCallback, this);
+    if (governor_timeout_ > 0)
+      governor_timer_ = node_handle_.createTimer(ros::Duration(governor_timeout_), &EddieController::governorTimerCallback, this);
+  }
+}
+
+void EddieController::readSensorList(std::string name, std::vector<int> &sensors)
+{
+  XmlRpc::XmlRpcValue list;
+  if (!node_handle_.getParam(name, list))
+    return;
+  if (list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+  {
+    ROS_ERROR("ERROR: parameter %s must be a list of sensor indices", name.data());
+    return;
+  }
+  sensors.clear();
+  for (int i = 0; i < list.size(); i++)
+    sensors.push_back(static_cast<int>(list[i]));
+}
+
+const eddie_realtime::Config& EddieController::realtime() const
+{
+  return realtime_;
 }
 
 void EddieController::velocityCallback(const parallax_eddie_robot::Velocity::ConstPtr& message)
 {
-  float linear = message->linear;
-  int16_t angular = message->angular;
+  ros::WallTime start = ros::WallTime::now();
+  double latency = message->trace.origin.isZero() ? 0 : (ros::Time::now() - message->trace.origin).toSec();
+
+  current_trace_ = message->trace;
+  trace(parallax_eddie_robot::TraceEvent::CONTROLLER_RECEIVE);
+  following_path_ = false;
+  last_linear_ = message->linear;
+  last_angular_ = message->angular;
+  last_scale_ = governorScale(last_linear_);
+  move(last_linear_ * last_scale_, governorAngular(last_linear_, last_scale_, last_angular_));
+
+  double duration = (ros::WallTime::now() - start).toSec();
+  velocity_stats_.record(latency, duration);
+  EDDIE_PROBE4(velocity__done, (int)(message->linear * 1000), (int)(message->angular * 1000),
+               (int64_t)(latency * 1e9), (int64_t)(duration * 1e9));
+}
+
+//The whole path goes to the driver in one call, which then tracks it against
+//encoder odometry on its speed loop without any further commands from here
+void EddieController::pathCallback(const parallax_eddie_robot::Path::ConstPtr& message)
+{
+  current_trace_ = message->trace;
+  trace(parallax_eddie_robot::TraceEvent::CONTROLLER_RECEIVE);
+  last_linear_ = 0;
+  last_angular_ = 0;
+  if (!message->points.empty() && governorScale(1) == 0)
+  {
+    ROS_ERROR("ERROR: path refused, an obstacle is within the governor stop distance");
+    return;
+  }
+  //the driver tracks a path at full speed, it cannot crawl along it
+  if (!message->points.empty() && governorBlind(ros::Time::now()))
+  {
+    ROS_ERROR("ERROR: path refused, the governor has no fresh ping readings");
+    return;
+  }
+
+  parallax_eddie_robot::FollowPath path;
+  path.request.points = message->points;
+  path.request.speed = message->speed;
+  if (call(eddie_follow_path_, path))
+  {
+    path_id_ = path.response.path_id;
+    following_path_ = !message->points.empty();
+    ROS_INFO("SUCCESS: Following path of %d points", (int)message->points.size());
+  }
+  else
+  {
+    following_path_ = false;
+    ROS_ERROR("ERROR: at trying to make Eddie follow a path. Please try sending it again.");
+  }
+}
+
+void EddieController::pathFeedbackCallback(const parallax_eddie_robot::PathFeedback::ConstPtr& message)
+{
+  if (message->path_id == path_id_ && message->status != "ACTIVE")
+    following_path_ = false;
+}
+
+void EddieController::distancesCallback(const parallax_eddie_robot::Distances::ConstPtr& message)
+{
+  //a reading of 0 means the sensor had no echo
+  front_clearance_ = rear_clearance_ = -1;
+  for (uint i = 0; i < front_sensors_.size(); i++)
+  {
+    if (front_sensors_[i] < (int)message->value.size() && message->value[front_sensors_[i]] > 0 &&
+        (front_clearance_ < 0 || message->value[front_sensors_[i]] < front_clearance_))
+      front_clearance_ = message->value[front_sensors_[i]];
+  }
+  for (uint i = 0; i < rear_sensors_.size(); i++)
+  {
+    if (rear_sensors_[i] < (int)message->value.size() && message->value[rear_sensors_[i]] > 0 &&
+        (rear_clearance_ < 0 || message->value[rear_sensors_[i]] < rear_clearance_))
+      rear_clearance_ = message->value[rear_sensors_[i]];
+  }
+  //age is measured from when the driver sampled the sensors, not from arrival
+  clearance_stamp_ = message->header.stamp.isZero() ? ros::Time::now() : message->header.stamp;
+
+  //paths are only ever driven forward
+  if (following_path_ && governorScale(1) == 0)
+  {
+    current_trace_ = parallax_eddie_robot::Trace();
+    following_path_ = false;
+    stop();
+  }
+
+  applyGovernor();
+}
+
+//Slows down an ongoing motion as soon as an obstacle closes in or the
+//readings stop, without waiting for the next velocity command
+void EddieController::applyGovernor()
+{
+  if (last_linear_ == 0 && last_angular_ == 0)
+    return;
+  float scale = governorScale(last_linear_);
+  int16_t angular = governorAngular(last_linear_, scale, last_angular_);
+  if (scale < last_scale_ - 0.1 || (scale == 0 && last_scale_ > 0) || angular != last_angular_)
+  {
+    current_trace_ = parallax_eddie_robot::Trace();
+    last_scale_ = scale;
+    last_angular_ = angular;
+    move(last_linear_ * scale, angular);
+  }
+}
+
+void EddieController::governorTimerCallback(const ros::TimerEvent& event)
+{
+  //a path is only ever stopped by a reading, so one must be stopped when they
+  //no longer arrive
+  if (following_path_ && governorBlind(ros::Time::now()))
+  {
+    ROS_WARN("Path cancelled, no ping readings for %.1f s", governor_timeout_);
+    current_trace_ = parallax_eddie_robot::Trace();
+    following_path_ = false;
+    stop();
+  }
+  applyGovernor();
+}
 
+void EddieController::irCallback(const parallax_eddie_robot::Voltages::ConstPtr& message)
+{
+  //IR sensors face forward and read a higher voltage the closer an obstacle is
+  ir_blocked_ = false;
+  for (uint i = 0; i < message->value.size(); i++)
+  {
+    if (message->value[i] >= governor_ir_stop_voltage_)
+      ir_blocked_ = true;
+  }
+  ir_stamp_ = message->header.stamp.isZero() ? ros::Time::now() : message->header.stamp;
+}
+
+//Returns the factor to apply to the linear command: 0 at or below
+//governor_stop_distance, 1 at or beyond governor_slow_distance and a linear
+//ramp in between. A direction without sensors is not governed. Missing or
+//stale readings leave the robot blind and give governor_crawl_scale.
+float EddieController::governorScale(float linear)
+{
+  if (!governor_enabled_ || linear == 0)
+    return 1;
+
+  ros::Time now = ros::Time::now();
+  if (linear > 0 && ir_blocked_ && (now - ir_stamp_).toSec() <= governor_timeout_)
+    return 0;
+
+  if ((linear > 0 ? front_sensors_ : rear_sensors_).empty())
+    return 1;
+  if (!governorFresh(now))
+    return governor_crawl_scale_;
+  //no echo from any sensor, nothing within range
+  int clearance = linear > 0 ? front_clearance_ : rear_clearance_;
+  if (clearance < 0)
+    return 1;
+  if (clearance <= governor_stop_distance_)
+    return 0;
+  if (clearance >= governor_slow_distance_)
+    return 1;
+  return (clearance - governor_stop_distance_) / (governor_slow_distance_ - governor_stop_distance_);
+}
+
+bool EddieController::governorFresh(ros::Time now) const
+{
+  return !clearance_stamp_.isZero() && (now - clearance_stamp_).toSec() <= governor_timeout_;
+}
+
+//True when forward travel, the only direction paths take, is governed but the
+//readings for it are missing or stale
+bool EddieController::governorBlind(ros::Time now) const
+{
+  return governor_enabled_ && !front_sensors_.empty() && !governorFresh(now);
+}
+
+//Rotation is held to the same rules: it stops with a linear command the
+//governor stopped, and without fresh readings it is only allowed when the
+//robot may crawl
+int16_t EddieController::governorAngular(float linear, float scale, int16_t angular)
+{
+  if (!governor_enabled_ || angular == 0)
+    return angular;
+  if (linear != 0 && scale == 0)
+    return 0;
+  if (front_sensors_.empty() && rear_sensors_.empty())
+    return angular;
+  if (!governorFresh(ros::Time::now()) && governor_crawl_scale_ == 0)
+    return 0;
+  return angular;
+}
+
+void EddieController::move(float linear, int16_t angular)
+{
   if (linear == 0 && angular == 0)
   {
     stop();
@@ -69,11 +329,33 @@ void EddieController::velocityCallback(const parallax_eddie_robot::Velocity::Con
     moveLinearAngular(linear, angular);
   }
 }
+void EddieController::trace(uint8_t stage)
+{
+  if (!trace_enabled_ || current_trace_.id == 0)
+    return;
+  parallax_eddie_robot::TraceEvent event;
+  event.trace = current_trace_;
+  event.stage = stage;
+  event.stamp = ros::Time::now();
+  trace_pub_.publish(event);
+}
+
+//Calls a driver service, carrying the current trace along with the request
+template <class Service>
+bool EddieController::call(ros::ServiceClient &client, Service &service)
+{
+  service.request.trace = current_trace_;
+  trace(parallax_eddie_robot::TraceEvent::SERVICE_CALL);
+  bool result = client.call(service);
+  trace(parallax_eddie_robot::TraceEvent::SERVICE_RETURN);
+  return result;
+}
+
 void EddieController::stop()
 {
   parallax_eddie_robot::StopAtDistance dist;
   dist.request.distance = 3;
-  for (int i = 0; !eddie_stop_.call(dist) && i < 5; i++)
+  for (int i = 0; !call(eddie_stop_, dist) && i < 5; i++)
   {
     ROS_ERROR("ERROR: at trying to stop Eddie. Trying to auto send command again...");
   }
@@ -93,17 +375,66 @@ int8_t EddieController::clipPower(int power_unit, float linear)
   return power;
 }
 
-void EddieController::moveLinear(float linear)
+int16_t EddieController::clipSpeed(int speed_unit, float linear)
 {
-  parallax_eddie_robot::DriveWithPower power;
-  int8_t left, right;
+  float speed = speed_unit * linear;
+  if (speed > 32767)
+    return 32767;
+  if (speed < -32767)
+    return -32767;
+  return (int16_t)speed;
+}
 
-  left = clipPower(left_power_, linear);
-  right = clipPower(right_power_, linear);
+//Whether move commands are worked out in wheel speeds rather than power
+bool EddieController::speedUnits() const
+{
+  return closed_loop_ || !motor_table_.empty();
+}
 
+//Sends wheel power levels, or wheel speeds when in closed-loop mode. Speeds
+//given without the closed loop are turned into power with the motor table.
+bool EddieController::drive(int left, int right)
+{
+  if (closed_loop_)
+  {
+    parallax_eddie_robot::DriveClosedLoop speed;
+    speed.request.left = left;
+    speed.request.right = right;
+    return call(eddie_drive_closed_loop_, speed);
+  }
+  if (!motor_table_.empty())
+  {
+    //past what the weaker wheel can do both slow down together, keeping the
+    //ratio between them and so the curvature
+    double scale = 1;
+    if (left != 0)
+      scale = std::min(scale, motor_table_.maxSpeed(left) / abs(left));
+    if (right != 0)
+      scale = std::min(scale, motor_table_.maxSpeed(right) / abs(right));
+    left = motor_table_.power(EddieMotorTable::LEFT, left * scale);
+    right = motor_table_.power(EddieMotorTable::RIGHT, right * scale);
+  }
+  parallax_eddie_robot::DriveWithPower power;
   power.request.left = left;
   power.request.right = right;
-  if (eddie_drive_power_.call(power))
+  return call(eddie_drive_power_, power);
+}
+
+void EddieController::moveLinear(float linear)
+{
+  int left, right;
+
+  if (speedUnits())
+  {
+    left = right = clipSpeed(wheel_speed_, linear);
+  }
+  else
+  {
+    left = clipPower(left_power_, linear);
+    right = clipPower(right_power_, linear);
+  }
+
+  if (drive(left, right))
   {
     if (linear / abs(linear) > 0)
       ROS_INFO("SUCCESS: Moving FORWARD");
@@ -121,7 +452,7 @@ void EddieController::moveAngular(int16_t angular)
   parallax_eddie_robot::Rotate degree;
   degree.request.angle = angular;
   degree.request.speed = rotation_speed_;
-  if (eddie_turn_.call(degree))
+  if (call(eddie_turn_, degree))
   {
     if (angular / abs(angular) > 0)
       ROS_INFO("SUCCESS: rotating RIGHT");
@@ -136,23 +467,20 @@ void EddieController::moveAngular(int16_t angular)
 
 void EddieController::moveLinearAngular(float linear, int16_t angular)
 {
-  parallax_eddie_robot::DriveWithPower power;
-  int8_t left, right;
+  int left, right;
   if(angular>0)
   {
     angular = angular % 360;
-    left = clipPower(left_power_, linear);
-    right = left - (int8_t)(left * (float)angular/180);
+    left = speedUnits() ? clipSpeed(wheel_speed_, linear) : clipPower(left_power_, linear);
+    right = left - (int)(left * (float)angular/180);
   }
   else
   {
     angular = angular % 360;
-    right = clipPower(right_power_, linear);
-    left = right - (int8_t)(right * (float)angular/-180);
+    right = speedUnits() ? clipSpeed(wheel_speed_, linear) : clipPower(right_power_, linear);
+    left = right - (int)(right * (float)angular/-180);
   }
-  power.request.left = left;
-  power.request.right = right;
-  if (eddie_drive_power_.call(power))
+  if (drive(left, right))
   {
     if (linear / abs(linear) > 0)
       ROS_INFO("SUCCESS: Moving with angular. Linear: %f, angular: %d", linear, angular);
@@ -171,6 +499,12 @@ int main(int argc, char** argv)
 {
   ros::init(argc, argv, "eddie_controller");
   EddieController controller;
+  //callbacks run on this thread, which ros::spin() keeps
+  if (controller.realtime().enabled)
+  {
+    eddie_realtime::lockMemory(controller.realtime().heap_prefault);
+    eddie_realtime::configureThread(pthread_self(), controller.realtime().priority, controller.realtime().cpus, "controller");
+  }
   ros::spin();
 
   return (EXIT_SUCCESS);
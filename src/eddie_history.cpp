@@ -0,0 +1,165 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_history.h"
+#include <cmath>
+
+EddieHistory::EddieHistory(size_t capacity, double wrap) :
+  slots_(capacity < 2 ? 2 : capacity), wrap_(wrap), count_(0)
+{
+  for (size_t i = 0; i < slots_.size(); i++)
+    slots_[i].sequence = 0;
+}
+
+void EddieHistory::record(ros::Time stamp, double first, double second)
+{
+  boost::mutex::scoped_lock lock(write_mutex_);
+  int64_t nsec = stamp.toNSec();
+  if (count_ > 0 && nsec <= slots_[(count_ - 1) % slots_.size()].stamp)
+    return;
+
+  Slot &slot = slots_[count_ % slots_.size()];
+  slot.sequence++;
+  __sync_synchronize();
+  slot.stamp = nsec;
+  slot.value[0] = first;
+  slot.value[1] = second;
+  __sync_synchronize();
+  slot.sequence++;
+  count_++;
+  __sync_synchronize();
+}
+
+size_t EddieHistory::capacity() const
+{
+  return slots_.size();
+}
+
+//Copies the slot holding sample index, false if it was being overwritten
+bool EddieHistory::readSlot(uint64_t index, Slot &slot) const
+{
+  const Slot &source = slots_[index % slots_.size()];
+  uint32_t before = source.sequence;
+  __sync_synchronize();
+  slot.stamp = source.stamp;
+  slot.value[0] = source.value[0];
+  slot.value[1] = source.value[1];
+  __sync_synchronize();
+  return !(before & 1) && before == source.sequence;
+}
+
+double EddieHistory::interpolate(double from, double to, double fraction) const
+{
+  double delta = to - from;
+  //circular quantities go the short way round
+  if (wrap_ > 0)
+  {
+    delta = fmod(delta, wrap_);
+    if (delta > wrap_ / 2)
+      delta -= wrap_;
+    else if (delta < -wrap_ / 2)
+      delta += wrap_;
+  }
+  double value = from + delta * fraction;
+  if (wrap_ > 0)
+  {
+    value = fmod(value, wrap_);
+    if (value < 0)
+      value += wrap_;
+  }
+  return value;
+}
+
+bool EddieHistory::query(ros::Time stamp, double max_extrapolation, double (&values)[FIELDS], bool &extrapolated) const
+{
+  int64_t target = stamp.toNSec();
+
+  //a query overlapping a write of a slot it reads starts over
+  for (int attempt = 0; attempt < 8; attempt++)
+  {
+    __sync_synchronize();
+    uint64_t count = count_;
+    if (count < 2)
+      return false;
+    //the oldest slot is the next one to be overwritten, leave it out
+    uint64_t first = count > slots_.size() ? count - slots_.size() + 1 : 0;
+    uint64_t last = count - 1;
+
+    Slot newest, oldest;
+    if (!readSlot(last, newest) || !readSlot(first, oldest))
+      continue;
+    if (target < oldest.stamp || target > newest.stamp + (int64_t)(max_extrapolation * 1e9))
+      return false;
+
+    //find the last sample at or before target, O(log n)
+    uint64_t low = first, high = last;
+    bool torn = false;
+    if (target >= newest.stamp)
+      low = last - 1;
+    else
+    {
+      while (high - low > 1)
+      {
+        uint64_t middle = low + (high - low) / 2;
+        Slot slot;
+        if (!readSlot(middle, slot))
+        {
+          torn = true;
+          break;
+        }
+        if (slot.stamp <= target)
+          low = middle;
+        else
+          high = middle;
+      }
+      high = low + 1;
+    }
+
+    Slot before, after;
+    if (torn || !readSlot(low, before) || !readSlot(high, after) || after.stamp <= before.stamp)
+      continue;
+    //a slot that was reused for a newer sample in the meantime reads as
+    //consistent, so check that the writer has not lapped the search
+    __sync_synchronize();
+    if (count_ >= low + slots_.size())
+      continue;
+
+    double fraction = (double)(target - before.stamp) / (after.stamp - before.stamp);
+    for (int i = 0; i < FIELDS; i++)
+      values[i] = interpolate(before.value[i], after.value[i], fraction);
+    extrapolated = target > after.stamp;
+    return true;
+  }
+  return false;
+}
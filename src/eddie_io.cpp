@@ -0,0 +1,332 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_io.h"
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <algorithm>
+
+EddieIO::EddieIO() :
+  running_(true)
+{
+  epoll_fd_ = epoll_create(16);
+  if (pipe(wake_pipe_) == 0)
+  {
+    fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = wake_pipe_[0];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_pipe_[0], &event);
+  }
+  io_thread_ = boost::thread(&EddieIO::ioLoop, this);
+}
+
+EddieIO::~EddieIO()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    running_ = false;
+  }
+  char c = 0;
+  if (write(wake_pipe_[1], &c, 1) < 0)
+    ROS_ERROR("ERROR: unable to wake up the serial I/O thread");
+  io_thread_.join();
+
+  for (std::map<int, Channel*>::iterator it = channels_.begin(); it != channels_.end(); ++it)
+  {
+    ::close(it->first);
+    delete it->second;
+  }
+  ::close(wake_pipe_[0]);
+  ::close(wake_pipe_[1]);
+  ::close(epoll_fd_);
+}
+
+void EddieIO::setRealtime(int priority, const std::vector<int> &cpus)
+{
+  eddie_realtime::configureThread(io_thread_.native_handle(), priority, cpus, "serial I/O");
+}
+
+int EddieIO::open(std::string port)
+{
+  struct termios tio;
+  memset(&tio, 0, sizeof (tio));
+  tio.c_iflag = 0;
+  tio.c_oflag = 0;
+  tio.c_cflag = CS8 | CREAD | CLOCAL; // 8n1, see termios.h for more information
+  tio.c_lflag = 0;
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 5;
+
+  int fd = ::open(port.data(), O_RDWR | O_NONBLOCK);
+  if (fd < 0)
+  {
+    ROS_ERROR("ERROR: unable to open serial port %s", port.data());
+    return -1;
+  }
+  cfsetospeed(&tio, B115200); // 115200 baud
+  cfsetispeed(&tio, B115200); // 115200 baud
+  tcsetattr(fd, TCSANOW, &tio);
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    Channel *channel = new Channel;
+    channel->port = port;
+    channel->last_read_clock = 0;
+    channels_[fd] = channel;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  return fd;
+}
+
+void EddieIO::close(int channel)
+{
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, channel, NULL);
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<int, Channel*>::iterator it = channels_.find(channel);
+  if (it == channels_.end())
+    return;
+  ::close(it->first);
+  delete it->second;
+  channels_.erase(it);
+}
+
+bool EddieIO::transact(int channel, const char* data, size_t size, std::string &response,
+                       ros::Time *written_time, ros::Time *received_time, double *round_trip,
+                       double timeout)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<int, Channel*>::iterator it = channels_.find(channel);
+  if (it == channels_.end())
+    return false;
+  Channel *ch = it->second;
+
+  //whatever is left over belongs to a command that already timed out
+  ch->pending.clear();
+  lock.unlock();
+
+  if (!writeAll(channel, data, size, timeout))
+    return false;
+  double written_clock = eddie_realtime::monotonicNow();
+  if (written_time)
+    *written_time = ros::Time::now();
+
+  lock.lock();
+  double deadline = written_clock + timeout;
+  size_t end;
+  while ((end = ch->pending.find('\r')) == std::string::npos)
+  {
+    //a lost terminator times out like a lost response
+    if (!ch->received.waitUntil(lock, deadline) && ch->pending.find('\r') == std::string::npos)
+      return false;
+  }
+  response = ch->pending.substr(0, end + 1);
+  ch->pending.erase(0, end + 1);
+  if (received_time)
+    *received_time = ch->last_read;
+  if (round_trip)
+    *round_trip = ch->last_read_clock - written_clock;
+  return true;
+}
+
+size_t EddieIO::pipeline(int channel, std::vector<Request> &requests, size_t window)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<int, Channel*>::iterator it = channels_.find(channel);
+  if (it == channels_.end())
+    return 0;
+  Channel *ch = it->second;
+  ch->pending.clear();
+
+  size_t written = 0, answered = 0, in_flight = 0;
+  std::vector<double> written_clock(requests.size());
+  double last_received = 0;
+  while (answered < requests.size())
+  {
+    //one command is always allowed out, whatever its size
+    while (written < requests.size() && (written == answered || in_flight + requests[written].size <= window))
+    {
+      lock.unlock();
+      bool ok = writeAll(channel, requests[written].data, requests[written].size,
+                         requests[written].timeout);
+      written_clock[written] = eddie_realtime::monotonicNow();
+      ros::Time now = ros::Time::now();
+      lock.lock();
+      if (!ok)
+        break;
+      requests[written].written_time = now;
+      in_flight += requests[written].size;
+      written++;
+    }
+    if (written == answered)
+      return answered;
+
+    //the firmware only starts on a command once it has answered the one
+    //before, so its timeout runs from whichever happened last
+    Request &request = requests[answered];
+    double deadline = std::max(written_clock[answered], last_received) + request.timeout;
+    size_t end;
+    while ((end = ch->pending.find('\r')) == std::string::npos)
+    {
+      if (!ch->received.waitUntil(lock, deadline) && ch->pending.find('\r') == std::string::npos)
+        return answered;
+    }
+    request.response = ch->pending.substr(0, end + 1);
+    ch->pending.erase(0, end + 1);
+    request.received_time = ch->last_read;
+    last_received = ch->last_read_clock;
+    request.round_trip = last_received - written_clock[answered];
+    in_flight -= request.size;
+    answered++;
+  }
+  return answered;
+}
+
+void EddieIO::resync(int channel, const char* data, size_t size, double settle_time)
+{
+  writeAll(channel, data, size, settle_time);
+
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<int, Channel*>::iterator it = channels_.find(channel);
+  if (it == channels_.end())
+    return;
+  Channel *ch = it->second;
+  //bounded, in case the other end never stops talking
+  for (int i = 0; i < 20; i++)
+  {
+    size_t before = ch->pending.size();
+    ch->received.waitUntil(lock, eddie_realtime::monotonicNow() + settle_time);
+    if (ch->pending.size() == before)
+      break;
+  }
+  ch->pending.clear();
+}
+
+bool EddieIO::writeAll(int fd, const char* data, size_t size, double timeout)
+{
+  size_t sent = 0;
+  while (sent < size)
+  {
+    ssize_t written = write(fd, data + sent, size - sent);
+    if (written > 0)
+      sent += written;
+    else if (written < 0 && errno == EAGAIN)
+    {
+      //the output buffer is full: sleep until the port drains rather than spin
+      if (!waitWritable(fd, timeout))
+        return false;
+    }
+    else if (written < 0 && errno != EINTR)
+      return false;
+  }
+  return true;
+}
+
+bool EddieIO::waitWritable(int fd, double timeout)
+{
+  //the shared epoll set only watches for input, so use a private one
+  int epoll_fd = epoll_create(1);
+  if (epoll_fd < 0)
+    return false;
+  struct epoll_event event;
+  event.events = EPOLLOUT;
+  event.data.fd = fd;
+  int count = -1;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+  {
+    do
+      count = epoll_wait(epoll_fd, &event, 1, std::max(1, (int)(timeout * 1000)));
+    while (count < 0 && errno == EINTR);
+  }
+  ::close(epoll_fd);
+  return count > 0 && !(event.events & (EPOLLERR | EPOLLHUP));
+}
+
+void EddieIO::ioLoop()
+{
+  struct epoll_event events[16];
+  char buffer[256];
+
+  while (true)
+  {
+    int count = epoll_wait(epoll_fd_, events, 16, -1);
+    if (count < 0 && errno != EINTR)
+    {
+      ROS_ERROR("ERROR: serial I/O thread unable to wait for data");
+      return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+      int fd = events[i].data.fd;
+      if (fd == wake_pipe_[0])
+      {
+        while (read(fd, buffer, sizeof (buffer)) > 0);
+        boost::mutex::scoped_lock lock(mutex_);
+        if (!running_)
+          return;
+        continue;
+      }
+
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+      {
+        //stop watching a port that went away, its commands will time out
+        ROS_ERROR("ERROR: serial port closed unexpectedly");
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
+        continue;
+      }
+
+      ssize_t n;
+      while ((n = read(fd, buffer, sizeof (buffer))) > 0)
+      {
+        double clock = eddie_realtime::monotonicNow();
+        ros::Time now = ros::Time::now();
+        boost::mutex::scoped_lock lock(mutex_);
+        std::map<int, Channel*>::iterator it = channels_.find(fd);
+        if (it == channels_.end())
+          break;
+        it->second->pending.append(buffer, n);
+        it->second->last_read = now;
+        it->second->last_read_clock = clock;
+        it->second->received.notifyAll();
+      }
+    }
+  }
+}
@@ -0,0 +1,310 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_load.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <parallax_eddie_robot/DriveWithPower.h>
+#include <parallax_eddie_robot/GetDistance.h>
+#include <parallax_eddie_robot/GetHeading.h>
+#include <parallax_eddie_robot/GetSpeed.h>
+
+static const char* SERVICE_NAMES[] = {
+  "get_distance",
+  "get_speed",
+  "get_heading",
+  "drive_with_power"
+};
+
+EddieLoad::EddieLoad() :
+  clients_(8), duration_(10), baseline_(5), client_rate_(0), drive_power_(0), loaded_(false)
+{
+  std::string topic_namespace = "/eddie";
+  node_handle_.param<std::string>("load_topic_namespace", topic_namespace, topic_namespace);
+  //a fleet board advertises its services in its topic namespace, the single
+  //board driver at the root, so load_service_namespace is "/" for that one
+  service_namespace_ = topic_namespace;
+  node_handle_.param<std::string>("load_service_namespace", service_namespace_, service_namespace_);
+  if (service_namespace_.empty() || service_namespace_[service_namespace_.size() - 1] != '/')
+    service_namespace_ += "/";
+  node_handle_.param("load_clients", clients_, clients_);
+  node_handle_.param("load_duration", duration_, duration_);
+  node_handle_.param("load_baseline", baseline_, baseline_);
+  node_handle_.param("load_client_rate", client_rate_, client_rate_);
+  //drive_with_power is left out unless asked for, and sends no power by default
+  weights_[GET_DISTANCE] = weights_[GET_SPEED] = weights_[GET_HEADING] = 1;
+  weights_[DRIVE_WITH_POWER] = 0;
+  for (int i = 0; i < SERVICE_COUNT; i++)
+    node_handle_.param(std::string("load_weight_") + SERVICE_NAMES[i], weights_[i], weights_[i]);
+  node_handle_.param("load_drive_power", drive_power_, drive_power_);
+
+  ping_sub_ = node_handle_.subscribe(topic_namespace + "/ping_data", 10, &EddieLoad::pingCallback, this);
+  adc_sub_ = node_handle_.subscribe(topic_namespace + "/adc_data", 10, &EddieLoad::adcCallback, this);
+}
+
+void EddieLoad::pingCallback(const parallax_eddie_robot::Ping::ConstPtr& message)
+{
+  record(ping_arrivals_);
+}
+
+void EddieLoad::adcCallback(const parallax_eddie_robot::ADC::ConstPtr& message)
+{
+  record(adc_arrivals_);
+}
+
+void EddieLoad::record(Arrivals &arrivals)
+{
+  double now = ros::WallTime::now().toSec();
+  boost::mutex::scoped_lock lock(arrivals_mutex_);
+  (loaded_ ? arrivals.loaded : arrivals.quiet).push_back(now);
+}
+
+void EddieLoad::run()
+{
+  double total = 0;
+  for (int i = 0; i < SERVICE_COUNT; i++)
+    total += std::max(weights_[i], 0.0);
+  if (total <= 0 || clients_ < 1)
+  {
+    ROS_ERROR("ERROR: load_clients and at least one load_weight_* must be positive");
+    return;
+  }
+
+  ROS_INFO("Measuring publishing jitter without load for %.1f s", baseline_);
+  ros::WallDuration(baseline_).sleep();
+
+  ROS_INFO("Calling services from %d clients for %.1f s", clients_, duration_);
+  {
+    boost::mutex::scoped_lock lock(arrivals_mutex_);
+    loaded_ = true;
+  }
+  ros::WallTime start = ros::WallTime::now();
+  ros::WallTime end = start + ros::WallDuration(duration_);
+  std::vector<std::vector<Call> > calls(clients_);
+  boost::thread_group threads;
+  for (int i = 0; i < clients_; i++)
+    threads.create_thread(boost::bind(&EddieLoad::client, this, i, end, &calls[i]));
+  threads.join_all();
+  double elapsed = (ros::WallTime::now() - start).toSec();
+  {
+    boost::mutex::scoped_lock lock(arrivals_mutex_);
+    loaded_ = false;
+  }
+
+  std::vector<double> latencies[SERVICE_COUNT];
+  unsigned errors[SERVICE_COUNT] = {0};
+  std::vector<double> all;
+  unsigned all_errors = 0;
+  for (int i = 0; i < clients_; i++)
+  {
+    for (size_t j = 0; j < calls[i].size(); j++)
+    {
+      const Call &call = calls[i][j];
+      latencies[call.service].push_back(call.latency);
+      all.push_back(call.latency);
+      if (!call.ok)
+      {
+        errors[call.service]++;
+        all_errors++;
+      }
+    }
+  }
+
+  printf("\n%d clients for %.1f s, latencies in ms\n", clients_, elapsed);
+  printf("%-18s %8s %9s %7s %9s %9s %9s %9s\n", "service", "calls", "calls/s", "errors", "p50", "p90", "p99", "max");
+  for (int i = 0; i < SERVICE_COUNT; i++)
+  {
+    if (latencies[i].empty())
+      continue;
+    double max = *std::max_element(latencies[i].begin(), latencies[i].end());
+    printf("%-18s %8u %9.1f %6.2f%% %9.3f %9.3f %9.3f %9.3f\n", SERVICE_NAMES[i], (unsigned)latencies[i].size(),
+           latencies[i].size() / elapsed, 100.0 * errors[i] / latencies[i].size(),
+           percentile(latencies[i], 0.5), percentile(latencies[i], 0.9), percentile(latencies[i], 0.99), max);
+  }
+  if (!all.empty())
+  {
+    double max = *std::max_element(all.begin(), all.end());
+    printf("%-18s %8u %9.1f %6.2f%% %9.3f %9.3f %9.3f %9.3f\n", "all", (unsigned)all.size(),
+           all.size() / elapsed, 100.0 * all_errors / all.size(),
+           percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), max);
+  }
+
+  printf("\npublishing intervals in ms, quiet / under load\n");
+  printf("%-12s %15s %15s %15s %15s\n", "topic", "messages", "mean", "p99", "max");
+  boost::mutex::scoped_lock lock(arrivals_mutex_);
+  reportJitter("ping_data", ping_arrivals_);
+  reportJitter("adc_data", adc_arrivals_);
+  fflush(stdout);
+}
+
+void EddieLoad::client(int index, ros::WallTime end, std::vector<Call> *calls)
+{
+  std::vector<ros::ServiceClient> services(SERVICE_COUNT);
+  unsigned int seed = index * 7919 + 1;
+  double total = 0;
+  for (int i = 0; i < SERVICE_COUNT; i++)
+    total += std::max(weights_[i], 0.0);
+  ros::WallDuration period(client_rate_ > 0 ? 1 / client_rate_ : 0);
+  ros::WallTime next = ros::WallTime::now();
+
+  while (ros::ok() && ros::WallTime::now() < end)
+  {
+    double pick = total * rand_r(&seed) / ((double)RAND_MAX + 1);
+    int service = 0;
+    while (service < SERVICE_COUNT - 1 && pick >= std::max(weights_[service], 0.0))
+      pick -= std::max(weights_[service++], 0.0);
+
+    ros::WallTime sent = ros::WallTime::now();
+    Call call;
+    call.service = service;
+    call.ok = this->call(service, services);
+    call.latency = (ros::WallTime::now() - sent).toSec() * 1000;
+    calls->push_back(call);
+
+    if (client_rate_ > 0)
+    {
+      next += period;
+      ros::WallTime::sleepUntil(next);
+    }
+  }
+}
+
+//Each client keeps its own persistent connections, reopened after a failure
+bool EddieLoad::call(int service, std::vector<ros::ServiceClient> &services)
+{
+  ros::ServiceClient &client = services[service];
+  if (!client.isValid())
+  {
+    switch (service)
+    {
+      case GET_DISTANCE:
+        client = node_handle_.serviceClient<parallax_eddie_robot::GetDistance > (service_namespace_ + SERVICE_NAMES[service], true);
+        break;
+      case GET_SPEED:
+        client = node_handle_.serviceClient<parallax_eddie_robot::GetSpeed > (service_namespace_ + SERVICE_NAMES[service], true);
+        break;
+      case GET_HEADING:
+        client = node_handle_.serviceClient<parallax_eddie_robot::GetHeading > (service_namespace_ + SERVICE_NAMES[service], true);
+        break;
+      default:
+        client = node_handle_.serviceClient<parallax_eddie_robot::DriveWithPower > (service_namespace_ + SERVICE_NAMES[service], true);
+    }
+  }
+
+  switch (service)
+  {
+    case GET_DISTANCE:
+    {
+      parallax_eddie_robot::GetDistance request;
+      return client.call(request);
+    }
+    case GET_SPEED:
+    {
+      parallax_eddie_robot::GetSpeed request;
+      return client.call(request);
+    }
+    case GET_HEADING:
+    {
+      parallax_eddie_robot::GetHeading request;
+      return client.call(request);
+    }
+    default:
+    {
+      parallax_eddie_robot::DriveWithPower request;
+      request.request.left = drive_power_;
+      request.request.right = drive_power_;
+      return client.call(request);
+    }
+  }
+}
+
+//Intervals between consecutive messages of each phase. Callers must hold
+//arrivals_mutex_.
+void EddieLoad::reportJitter(const char* topic, Arrivals &arrivals)
+{
+  std::vector<double> phases[2];
+  const std::vector<double>* stamps[2] = { &arrivals.quiet, &arrivals.loaded };
+  char columns[4][2][16];
+  for (int phase = 0; phase < 2; phase++)
+  {
+    for (size_t i = 1; i < stamps[phase]->size(); i++)
+      phases[phase].push_back(((*stamps[phase])[i] - (*stamps[phase])[i - 1]) * 1000);
+    std::vector<double> &intervals = phases[phase];
+    double mean = 0, max = 0, p99 = 0;
+    if (!intervals.empty())
+    {
+      for (size_t i = 0; i < intervals.size(); i++)
+        mean += intervals[i];
+      mean /= intervals.size();
+      max = *std::max_element(intervals.begin(), intervals.end());
+      p99 = percentile(intervals, 0.99);
+    }
+    snprintf(columns[0][phase], 16, "%u", (unsigned)stamps[phase]->size());
+    snprintf(columns[1][phase], 16, "%.1f", mean);
+    snprintf(columns[2][phase], 16, "%.1f", p99);
+    snprintf(columns[3][phase], 16, "%.1f", max);
+  }
+  printf("%-12s", topic);
+  for (int column = 0; column < 4; column++)
+  {
+    char cell[40];
+    snprintf(cell, sizeof (cell), "%s / %s", columns[column][0], columns[column][1]);
+    printf(" %15s", cell);
+  }
+  printf("\n");
+}
+
+double EddieLoad::percentile(std::vector<double> &values, double p)
+{
+  if (values.empty())
+    return 0;
+  size_t n = (size_t)(p * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "eddie_load");
+  EddieLoad load;
+  //subscriber callbacks run here while the clients run on their own threads
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+  load.run();
+  spinner.stop();
+
+  return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_log.h"
+#include <ros/ros.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <boost/static_assert.hpp>
+
+namespace eddie_log
+{
+
+BOOST_STATIC_ASSERT(sizeof (SegmentHeader) <= HEADER_SIZE);
+
+Writer::Writer(std::string directory, std::string prefix, size_t segment_size, size_t queue_size) :
+  directory_(directory), prefix_(prefix), segment_size_(segment_size),
+  queue_(queue_size + 1), queue_head_(0), queue_tail_(0), batch_(queue_size + 1), written_(0), dropped_(0)
+{
+  for (int i = 0; i < STREAM_COUNT; i++)
+  {
+    segments_[i].fd = -1;
+    segments_[i].base = NULL;
+    segments_[i].header = NULL;
+    segments_[i].sequence = 0;
+  }
+  writer_thread_ = boost::thread(&Writer::writerLoop, this);
+}
+
+Writer::~Writer()
+{
+  writer_thread_.interrupt();
+  writer_thread_.join();
+  drain();
+  for (int i = 0; i < STREAM_COUNT; i++)
+    closeSegment(i);
+}
+
+bool Writer::record(const Sample &sample)
+{
+  //another producer holding the queue is treated like a full queue
+  boost::mutex::scoped_try_lock lock(queue_mutex_);
+  if (!lock.owns_lock())
+  {
+    __sync_fetch_and_add(&dropped_, 1);
+    return false;
+  }
+  size_t next = (queue_tail_ + 1) % queue_.size();
+  if (next == queue_head_)
+  {
+    __sync_fetch_and_add(&dropped_, 1);
+    return false;
+  }
+  queue_[queue_tail_] = sample;
+  queue_tail_ = next;
+  return true;
+}
+
+uint64_t Writer::written() const
+{
+  return __sync_add_and_fetch(const_cast<volatile uint64_t*>(&written_), 0);
+}
+
+uint64_t Writer::dropped() const
+{
+  return __sync_add_and_fetch(const_cast<volatile uint64_t*>(&dropped_), 0);
+}
+
+void Writer::writerLoop()
+{
+  try
+  {
+    while (true)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      drain();
+    }
+  }
+  catch (boost::thread_interrupted&)
+  {
+  }
+}
+
+//Copies queued samples into the segments. The queue lock is taken once to
+//move everything queued into the batch, never while writing to the mapped
+//files, so producers rarely find it held.
+void Writer::drain()
+{
+  size_t count = 0;
+  {
+    boost::mutex::scoped_lock lock(queue_mutex_);
+    while (queue_head_ != queue_tail_)
+    {
+      batch_[count++] = queue_[queue_head_];
+      queue_head_ = (queue_head_ + 1) % queue_.size();
+    }
+  }
+  for (size_t i = 0; i < count; i++)
+    append(batch_[i]);
+  __sync_fetch_and_add(&written_, count);
+}
+
+void Writer::append(const Sample &sample)
+{
+  if (sample.stream >= STREAM_COUNT)
+    return;
+  Segment &segment = segments_[sample.stream];
+  if (segment.header && segment.header->count >= segment.header->capacity)
+    closeSegment(sample.stream);
+  if (!segment.header && !openSegment(sample.stream))
+    return;
+
+  SegmentHeader &header = *segment.header;
+  uint32_t index = header.count;
+  ((int64_t*)(segment.base + timestampColumn(header)))[index] = sample.stamp;
+  for (int field = 0; field < header.field_count; field++)
+  {
+    char* column = segment.base + fieldColumn(header, field);
+    if (header.field_size == 2)
+      ((int16_t*)column)[index] = (int16_t)sample.value[field];
+    else
+      ((int32_t*)column)[index] = sample.value[field];
+  }
+  if (index == 0)
+    header.first_stamp = sample.stamp;
+  header.last_stamp = sample.stamp;
+  __sync_synchronize();
+  header.count = index + 1;
+}
+
+bool Writer::openSegment(int stream)
+{
+  const StreamLayout &layout = STREAM_LAYOUTS[stream];
+  Segment &segment = segments_[stream];
+
+  char started[32];
+  time_t now = time(NULL);
+  strftime(started, sizeof (started), "%Y%m%d-%H%M%S", localtime(&now));
+  char name[64];
+  snprintf(name, sizeof (name), "_%s_%s_%04u.seg", layout.name, started, segment.sequence++);
+  std::string path = directory_ + "/" + prefix_ + name;
+
+  //the whole segment is allocated up front so that writes never extend the file
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || posix_fallocate(fd, 0, segment_size_) != 0)
+  {
+    ROS_ERROR("ERROR: Unable to allocate telemetry segment %s: %s", path.c_str(), strerror(errno));
+    if (fd >= 0)
+      ::close(fd);
+    return false;
+  }
+  void* base = mmap(NULL, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+  {
+    ROS_ERROR("ERROR: Unable to map telemetry segment %s: %s", path.c_str(), strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  segment.fd = fd;
+  segment.base = (char*)base;
+  segment.header = (SegmentHeader*)base;
+  memset(segment.header, 0, HEADER_SIZE);
+  memcpy(segment.header->magic, SEGMENT_MAGIC, sizeof (SEGMENT_MAGIC));
+  segment.header->version = SEGMENT_VERSION;
+  segment.header->stream = stream;
+  segment.header->field_count = layout.field_count;
+  segment.header->field_size = layout.field_size;
+  segment.header->field_signed = layout.field_signed;
+  segment.header->capacity = segmentCapacity(segment_size_, layout);
+  return true;
+}
+
+void Writer::closeSegment(int stream)
+{
+  Segment &segment = segments_[stream];
+  if (!segment.header)
+    return;
+  msync(segment.base, segment_size_, MS_ASYNC);
+  munmap(segment.base, segment_size_);
+  ::close(segment.fd);
+  segment.fd = -1;
+  segment.base = NULL;
+  segment.header = NULL;
+}
+
+}
@@ -0,0 +1,220 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_log.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+//==============================================================================//
+// Offline reader for the telemetry segments written by the driver. Prints a   //
+// per stream summary of every segment given on the command line (files or    //
+// directories), or with --csv dumps the samples of one stream.               //
+//==============================================================================//
+
+using namespace eddie_log;
+
+struct Summary
+{
+  uint64_t samples;
+  uint32_t segments;
+  int64_t first_stamp, last_stamp;
+  double sum[MAX_FIELDS];
+  int32_t min[MAX_FIELDS], max[MAX_FIELDS];
+};
+
+static int32_t fieldValue(const SegmentHeader &header, const char* column, uint32_t index)
+{
+  if (header.field_size == 4)
+    return ((const int32_t*)column)[index];
+  if (header.field_signed)
+    return ((const int16_t*)column)[index];
+  return ((const uint16_t*)column)[index];
+}
+
+static void listSegments(std::string path, std::vector<std::string> &files)
+{
+  DIR* dir = opendir(path.c_str());
+  if (!dir)
+  {
+    files.push_back(path);
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)))
+  {
+    std::string name = entry->d_name;
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0)
+      files.push_back(path + "/" + name);
+  }
+  closedir(dir);
+}
+
+//Maps a segment and either accumulates its columns into the summaries or
+//prints its rows, returns the bytes mapped
+static size_t scanSegment(std::string path, Summary* summaries, int csv_stream)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < HEADER_SIZE)
+  {
+    fprintf(stderr, "ERROR: Unable to read %s\n", path.c_str());
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+  void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: Unable to map %s\n", path.c_str());
+    return 0;
+  }
+
+  const char* base = (const char*)mapped;
+  const SegmentHeader &header = *(const SegmentHeader*)base;
+  if (memcmp(header.magic, SEGMENT_MAGIC, sizeof (SEGMENT_MAGIC)) != 0 || header.version != SEGMENT_VERSION ||
+      header.stream >= STREAM_COUNT || header.field_count > MAX_FIELDS ||
+      fieldColumn(header, header.field_count) > (size_t)st.st_size)
+  {
+    fprintf(stderr, "ERROR: %s is not a telemetry segment\n", path.c_str());
+    munmap(mapped, st.st_size);
+    return 0;
+  }
+
+  uint32_t count = std::min((uint32_t)header.count, header.capacity);
+  const int64_t* stamps = (const int64_t*)(base + timestampColumn(header));
+  if (csv_stream >= 0)
+  {
+    if (header.stream == csv_stream)
+    {
+      for (uint32_t i = 0; i < count; i++)
+      {
+        printf("%.9f", stamps[i] / 1e9);
+        for (int field = 0; field < header.field_count; field++)
+          printf(",%d", fieldValue(header, base + fieldColumn(header, field), i));
+        printf("\n");
+      }
+    }
+  }
+  else if (count > 0)
+  {
+    Summary &summary = summaries[header.stream];
+    if (summary.samples == 0 || header.first_stamp < summary.first_stamp)
+      summary.first_stamp = header.first_stamp;
+    if (summary.samples == 0 || header.last_stamp > summary.last_stamp)
+      summary.last_stamp = header.last_stamp;
+    //one pass down each column
+    for (int field = 0; field < header.field_count; field++)
+    {
+      const char* column = base + fieldColumn(header, field);
+      for (uint32_t i = 0; i < count; i++)
+      {
+        int32_t value = fieldValue(header, column, i);
+        summary.sum[field] += value;
+        if ((summary.samples == 0 && i == 0) || value < summary.min[field])
+          summary.min[field] = value;
+        if ((summary.samples == 0 && i == 0) || value > summary.max[field])
+          summary.max[field] = value;
+      }
+    }
+    summary.samples += count;
+  }
+  summaries[header.stream].segments++;
+
+  size_t bytes = fieldColumn(header, header.field_count);
+  munmap(mapped, st.st_size);
+  return bytes;
+}
+
+int main(int argc, char** argv)
+{
+  int csv_stream = -1;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+    {
+      i++;
+      for (int stream = 0; stream < STREAM_COUNT; stream++)
+        if (strcmp(argv[i], STREAM_LAYOUTS[stream].name) == 0)
+          csv_stream = stream;
+      if (csv_stream < 0)
+      {
+        fprintf(stderr, "ERROR: Unknown stream %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else
+      listSegments(argv[i], files);
+  }
+  if (files.empty())
+  {
+    fprintf(stderr, "Usage: eddie_log_reader [--csv ping|adc|encoder|heading|speed] <segment or directory>...\n");
+    return 1;
+  }
+  std::sort(files.begin(), files.end());
+
+  Summary summaries[STREAM_COUNT];
+  memset(summaries, 0, sizeof (summaries));
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  size_t bytes = 0;
+  for (size_t i = 0; i < files.size(); i++)
+    bytes += scanSegment(files[i], summaries, csv_stream);
+  gettimeofday(&end, NULL);
+  if (csv_stream >= 0)
+    return 0;
+
+  for (int stream = 0; stream < STREAM_COUNT; stream++)
+  {
+    const Summary &summary = summaries[stream];
+    if (summary.samples == 0)
+      continue;
+    printf("%s: %llu samples in %u segments over %.1f s\n", STREAM_LAYOUTS[stream].name,
+           (unsigned long long)summary.samples, summary.segments, (summary.last_stamp - summary.first_stamp) / 1e9);
+    for (int field = 0; field < STREAM_LAYOUTS[stream].field_count; field++)
+      printf("  [%d] min %d max %d mean %.1f\n", field, summary.min[field], summary.max[field],
+             summary.sum[field] / summary.samples);
+  }
+  double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  printf("Scanned %u segments, %.1f MB of columns in %.3f s\n", (unsigned)files.size(), bytes / 1e6, elapsed);
+  return 0;
+}
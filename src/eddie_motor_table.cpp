@@ -0,0 +1,143 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_motor_table.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+EddieMotorTable::EddieMotorTable()
+{
+  add(0, 0, 0);
+}
+
+bool EddieMotorTable::load(const std::string &path)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+    return false;
+
+  EddieMotorTable table;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    int power;
+    double left_speed, right_speed;
+    if (!(fields >> power >> left_speed >> right_speed) || power < -127 || power > 127)
+      return false;
+    table.add(power, left_speed, right_speed);
+  }
+  if (table.size() < 2)
+    return false;
+  *this = table;
+  return true;
+}
+
+bool EddieMotorTable::save(const std::string &path) const
+{
+  std::ofstream file(path.c_str());
+  file << "# GO power, left and right wheel speed in encoder ticks per second" << std::endl;
+  for (size_t i = 0; i < entries_.size(); i++)
+    file << entries_[i].power << " " << entries_[i].speed[LEFT] << " " << entries_[i].speed[RIGHT] << std::endl;
+  return file.good();
+}
+
+void EddieMotorTable::add(int power, double left_speed, double right_speed)
+{
+  Entry entry;
+  entry.power = power;
+  entry.speed[LEFT] = left_speed;
+  entry.speed[RIGHT] = right_speed;
+  std::vector<Entry>::iterator it = entries_.begin();
+  while (it != entries_.end() && it->power < power)
+    ++it;
+  if (it != entries_.end() && it->power == power)
+    *it = entry;
+  else
+    entries_.insert(it, entry);
+}
+
+bool EddieMotorTable::empty() const
+{
+  return entries_.size() < 2;
+}
+
+size_t EddieMotorTable::size() const
+{
+  return entries_.size();
+}
+
+//Walks outwards from power 0 in the direction of speed to the first level
+//that reaches it, so a reading that dips on the way does not send a small
+//speed to a large power
+int EddieMotorTable::power(Wheel wheel, double speed) const
+{
+  if (speed == 0)
+    return 0;
+  size_t zero = 0;
+  while (entries_[zero].power != 0)
+    zero++;
+
+  int step = speed > 0 ? 1 : -1;
+  size_t end = speed > 0 ? entries_.size() - 1 : 0;
+  for (size_t i = zero; i != end; i += step)
+  {
+    const Entry &from = entries_[i], &to = entries_[i + step];
+    if (fabs(to.speed[wheel]) < fabs(speed))
+      continue;
+    double span = to.speed[wheel] - from.speed[wheel];
+    double t = span != 0 ? (speed - from.speed[wheel]) / span : 1;
+    if (t < 0)
+      t = 0;
+    return (int)floor(from.power + t * (to.power - from.power) + 0.5);
+  }
+  return entries_[end].power;
+}
+
+double EddieMotorTable::maxSpeed(double speed) const
+{
+  double top[2] = { 0, 0 };
+  for (size_t i = 0; i < entries_.size(); i++)
+  {
+    if ((speed > 0) != (entries_[i].power > 0) || entries_[i].power == 0)
+      continue;
+    top[LEFT] = std::max(top[LEFT], fabs(entries_[i].speed[LEFT]));
+    top[RIGHT] = std::max(top[RIGHT], fabs(entries_[i].speed[RIGHT]));
+  }
+  return std::min(top[LEFT], top[RIGHT]);
+}
@@ -0,0 +1,121 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_odometry.h"
+#include <cmath>
+
+EddieOdometry::EddieOdometry() :
+  meters_per_tick_(0), wheel_base_(0),
+  x_(0), y_(0), theta_(0),
+  distance_(0), turned_(0),
+  referenced_(false), last_has_heading_(false),
+  last_left_(0), last_right_(0),
+  last_heading_(0)
+{
+}
+
+void EddieOdometry::setGeometry(double wheel_radius, int ticks_per_revolution, double wheel_base)
+{
+  meters_per_tick_ = ticks_per_revolution > 0 ? 2 * M_PI * wheel_radius / ticks_per_revolution : 0;
+  wheel_base_ = wheel_base;
+}
+
+void EddieOdometry::reset(double x, double y, double theta)
+{
+  x_ = x;
+  y_ = y;
+  theta_ = theta;
+  distance_ = turned_ = 0;
+  referenced_ = false;
+}
+
+bool EddieOdometry::update(int32_t left_ticks, int32_t right_ticks, bool has_heading, double heading)
+{
+  if (!referenced_)
+  {
+    referenced_ = true;
+    last_left_ = left_ticks;
+    last_right_ = right_ticks;
+    last_has_heading_ = has_heading;
+    last_heading_ = heading;
+    distance_ = turned_ = 0;
+    return false;
+  }
+
+  double left = (left_ticks - last_left_) * meters_per_tick_;
+  double right = (right_ticks - last_right_) * meters_per_tick_;
+  distance_ = (left + right) / 2;
+  if (has_heading && last_has_heading_)
+    turned_ = remainder(heading - last_heading_, 2 * M_PI);
+  else
+    turned_ = wheel_base_ > 0 ? (right - left) / wheel_base_ : 0;
+
+  //the step is taken along the mean of the headings at both ends
+  x_ += distance_ * cos(theta_ + turned_ / 2);
+  y_ += distance_ * sin(theta_ + turned_ / 2);
+  theta_ = remainder(theta_ + turned_, 2 * M_PI);
+
+  //a step without a reading was turned by the wheels, so the gyro only takes
+  //over again from the next pair of readings
+  last_left_ = left_ticks;
+  last_right_ = right_ticks;
+  last_has_heading_ = has_heading;
+  last_heading_ = heading;
+  return true;
+}
+
+double EddieOdometry::x() const
+{
+  return x_;
+}
+
+double EddieOdometry::y() const
+{
+  return y_;
+}
+
+double EddieOdometry::theta() const
+{
+  return theta_;
+}
+
+double EddieOdometry::distance() const
+{
+  return distance_;
+}
+
+double EddieOdometry::turned() const
+{
+  return turned_;
+}
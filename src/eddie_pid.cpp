@@ -0,0 +1,100 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_pid.h"
+
+EddiePID::EddiePID() :
+  kf_(0), kp_(0), ki_(0), kd_(0),
+  min_output_(-127), max_output_(127)
+{
+  reset();
+}
+
+void EddiePID::setGains(double kf, double kp, double ki, double kd)
+{
+  kf_ = kf;
+  kp_ = kp;
+  ki_ = ki;
+  kd_ = kd;
+}
+
+void EddiePID::setOutputLimits(double min, double max)
+{
+  min_output_ = min;
+  max_output_ = max;
+}
+
+void EddiePID::reset()
+{
+  integral_ = 0;
+  previous_measured_ = 0;
+  initialized_ = false;
+}
+
+double EddiePID::update(double setpoint, double measured, double dt)
+{
+  if (dt <= 0)
+    dt = 1e-3;
+
+  double error = setpoint - measured;
+
+  //derivative on measurement, so that a setpoint step does not kick the output
+  double derivative = 0;
+  if (initialized_)
+    derivative = -(measured - previous_measured_) / dt;
+  previous_measured_ = measured;
+  initialized_ = true;
+
+  double output = kf_ * setpoint + kp_ * error + integral_ + kd_ * derivative;
+  double integral_step = ki_ * error * dt;
+
+  //anti-windup: only integrate when it does not push further into saturation
+  if (!((output >= max_output_ && integral_step > 0) || (output <= min_output_ && integral_step < 0)))
+  {
+    integral_ += integral_step;
+    output += integral_step;
+  }
+
+  if (integral_ > max_output_ - min_output_)
+    integral_ = max_output_ - min_output_;
+  else if (integral_ < min_output_ - max_output_)
+    integral_ = min_output_ - max_output_;
+
+  if (output > max_output_)
+    output = max_output_;
+  else if (output < min_output_)
+    output = min_output_;
+
+  return output;
+}
@@ -49,6 +49,7 @@ void EddiePing::pingCallback(const parallax_eddie_robot::Ping::ConstPtr& message
     ROS_INFO("ERROR: Unable to read Ping data from ping sensors");
     return;
   }
+  distances.header = message->header;
   for (uint i = 0; i < message->value.size(); i++)
   {
     //OTHER WAYS OF ENCODING THE DATA MAY BE DONE HERE.
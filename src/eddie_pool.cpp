@@ -0,0 +1,176 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_pool.h"
+#include "eddie_realtime.h"
+
+EddiePool::Group::Group(EddiePool &pool) :
+  pool_(pool), pending_(0)
+{
+}
+
+void EddiePool::Group::run(const Task &task)
+{
+  Job job;
+  job.task = task;
+  job.group = this;
+  __sync_fetch_and_add(&pending_, 1);
+  pool_.submit(job);
+}
+
+void EddiePool::Group::wait()
+{
+  //the caller would only block otherwise, so it takes tasks too
+  while (pending_ > 0 && pool_.runOne(-1));
+
+  boost::mutex::scoped_lock lock(pool_.done_mutex_);
+  while (pending_ > 0)
+    pool_.group_done_.wait(lock);
+}
+
+EddiePool::EddiePool(int threads) :
+  queued_(0), next_(0), running_(true)
+{
+  for (int i = 0; i < threads; i++)
+    workers_.push_back(new Worker);
+  for (int i = 0; i < threads; i++)
+    workers_[i]->thread = boost::thread(&EddiePool::workerLoop, this, i);
+}
+
+EddiePool::~EddiePool()
+{
+  {
+    boost::mutex::scoped_lock lock(idle_mutex_);
+    running_ = false;
+    work_available_.notify_all();
+  }
+  //a worker can still be stealing from another's queue until every one has exited
+  for (size_t i = 0; i < workers_.size(); i++)
+    workers_[i]->thread.join();
+  for (size_t i = 0; i < workers_.size(); i++)
+    delete workers_[i];
+}
+
+int EddiePool::size() const
+{
+  return workers_.size();
+}
+
+void EddiePool::setRealtime(int priority, const std::vector<int> &cpus)
+{
+  for (size_t i = 0; i < workers_.size(); i++)
+    eddie_realtime::configureThread(workers_[i]->thread.native_handle(), priority, cpus, "processing worker");
+}
+
+//Tasks are dealt round robin, stealing evens out what that gets wrong
+void EddiePool::submit(const Job &job)
+{
+  if (workers_.empty())
+  {
+    job.task();
+    if (__sync_sub_and_fetch(&job.group->pending_, 1) == 0)
+    {
+      boost::mutex::scoped_lock lock(done_mutex_);
+      group_done_.notify_all();
+    }
+    return;
+  }
+
+  Worker *worker = workers_[__sync_fetch_and_add(&next_, 1) % workers_.size()];
+  {
+    boost::mutex::scoped_lock lock(worker->mutex);
+    worker->jobs.push_back(job);
+  }
+  boost::mutex::scoped_lock lock(idle_mutex_);
+  __sync_fetch_and_add(&queued_, 1);
+  work_available_.notify_one();
+}
+
+//Runs the newest task of worker index, or else the oldest task of any other
+//worker. An index of -1 only steals. Returns false if there was nothing to run.
+bool EddiePool::runOne(int index)
+{
+  Job job;
+  bool found = false;
+  if (index >= 0)
+  {
+    boost::mutex::scoped_lock lock(workers_[index]->mutex);
+    if (!workers_[index]->jobs.empty())
+    {
+      job = workers_[index]->jobs.back();
+      workers_[index]->jobs.pop_back();
+      found = true;
+    }
+  }
+  size_t first = index < 0 ? 0 : index + 1;
+  for (size_t i = 0; i < workers_.size() && !found; i++)
+  {
+    size_t victim_index = (first + i) % workers_.size();
+    if ((int)victim_index == index)
+      continue;
+    Worker *victim = workers_[victim_index];
+    boost::mutex::scoped_lock lock(victim->mutex);
+    if (!victim->jobs.empty())
+    {
+      job = victim->jobs.front();
+      victim->jobs.pop_front();
+      found = true;
+    }
+  }
+  if (!found)
+    return false;
+
+  __sync_fetch_and_sub(&queued_, 1);
+  job.task();
+  if (__sync_sub_and_fetch(&job.group->pending_, 1) == 0)
+  {
+    boost::mutex::scoped_lock lock(done_mutex_);
+    group_done_.notify_all();
+  }
+  return true;
+}
+
+void EddiePool::workerLoop(int index)
+{
+  while (true)
+  {
+    if (runOne(index))
+      continue;
+    boost::mutex::scoped_lock lock(idle_mutex_);
+    while (running_ && queued_ <= 0)
+      work_available_.wait(lock);
+    if (!running_)
+      return;
+  }
+}
@@ -0,0 +1,252 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_processing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <boost/bind.hpp>
+
+static const char* STAGE_NAMES[] = {
+  "ping filter",
+  "IR voltages",
+  "battery level",
+  "odometry"
+};
+
+EddieProcessing::EddieProcessing(ros::NodeHandle node_handle, std::string topic_namespace, int threads) :
+  node_handle_(node_handle),
+  ADC_VOLTAGE_DIVIDER(819),
+  BATTERY_VOLTAGE_MULTIPLIER(3.21),
+  ping_filter_window_(3),
+  battery_filter_(0.2),
+  battery_voltage_(-1),
+  has_odometry_(false),
+  report_period_(30),
+  frames_(0),
+  graph_time_(0)
+{
+  node_handle_.param("ping_filter_window", ping_filter_window_, ping_filter_window_);
+  node_handle_.param("battery_filter", battery_filter_, battery_filter_);
+  double wheel_radius = 0.0762, wheel_base = 0.39;
+  int ticks_per_revolution = 36;
+  node_handle_.param("wheel_radius", wheel_radius, wheel_radius);
+  node_handle_.param("wheel_base", wheel_base, wheel_base);
+  node_handle_.param("ticks_per_revolution", ticks_per_revolution, ticks_per_revolution);
+  dead_reckoning_.setGeometry(wheel_radius, ticks_per_revolution, wheel_base);
+  node_handle_.param("processing_report_period", report_period_, report_period_);
+  ping_filter_window_ = std::max(ping_filter_window_, 1);
+
+  distances_pub_ = node_handle_.advertise<parallax_eddie_robot::Distances > (topic_namespace + "/ping_distances", 1);
+  ir_pub_ = node_handle_.advertise<parallax_eddie_robot::Voltages > (topic_namespace + "/ir_voltages", 1);
+  battery_pub_ = node_handle_.advertise<parallax_eddie_robot::BatteryLevel > (topic_namespace + "/battery_level", 1);
+  odometry_pub_ = node_handle_.advertise<parallax_eddie_robot::Odometry > (topic_namespace + "/odometry", 10);
+
+  if (threads > 0)
+    pool_.reset(new EddiePool(threads));
+  for (int i = 0; i < STAGE_COUNT; i++)
+    stage_time_[i] = 0;
+  last_report_ = ros::WallTime::now();
+}
+
+EddieProcessing::~EddieProcessing()
+{
+  if (frames_ > 0)
+    report();
+}
+
+void EddieProcessing::setRealtime(int priority, const std::vector<int> &cpus)
+{
+  if (pool_)
+    pool_->setRealtime(priority, cpus);
+}
+
+void EddieProcessing::process(const eddie_telemetry::Frame &frame)
+{
+  ros::WallTime start = ros::WallTime::now();
+  if (pool_)
+  {
+    EddiePool::Group group(*pool_);
+    for (int i = 0; i < STAGE_COUNT; i++)
+      group.run(boost::bind(&EddieProcessing::runStage, this, i, boost::cref(frame)));
+    group.wait();
+  }
+  else
+  {
+    for (int i = 0; i < STAGE_COUNT; i++)
+      runStage(i, frame);
+  }
+  graph_time_ += (ros::WallTime::now() - start).toSec();
+  frames_++;
+
+  //every stage is done, so the outputs of one frame go out together
+  if (ready_[PING_FILTER])
+    distances_pub_.publish(distances_);
+  if (ready_[IR_VOLTAGES])
+    ir_pub_.publish(voltages_);
+  if (ready_[BATTERY_LEVEL])
+    battery_pub_.publish(battery_);
+  if (ready_[ODOMETRY])
+    odometry_pub_.publish(odometry_);
+
+  if (report_period_ > 0 && (ros::WallTime::now() - last_report_).toSec() >= report_period_)
+    report();
+}
+
+void EddieProcessing::runStage(int stage, const eddie_telemetry::Frame &frame)
+{
+  ros::WallTime start = ros::WallTime::now();
+  switch (stage)
+  {
+    case PING_FILTER:
+      ready_[stage] = filterPing(frame);
+      break;
+    case IR_VOLTAGES:
+      ready_[stage] = convertIR(frame);
+      break;
+    case BATTERY_LEVEL:
+      ready_[stage] = updateBattery(frame);
+      break;
+    case ODOMETRY:
+      ready_[stage] = updateOdometry(frame);
+      break;
+  }
+  stage_time_[stage] += (ros::WallTime::now() - start).toSec();
+}
+
+bool EddieProcessing::filterPing(const eddie_telemetry::Frame &frame)
+{
+  if (!frame.has_ping)
+    return false;
+  ping_history_.resize(frame.ping.size());
+  distances_.header.stamp = frame.ping_stamp;
+  distances_.value.resize(frame.ping.size());
+  std::vector<uint16_t> window;
+  for (size_t i = 0; i < frame.ping.size(); i++)
+  {
+    std::deque<uint16_t> &history = ping_history_[i];
+    if (frame.ping[i] > 0)
+      history.push_back(frame.ping[i]);
+    while ((int)history.size() > ping_filter_window_)
+      history.pop_front();
+    if (history.empty() || frame.ping[i] == 0)
+    {
+      distances_.value[i] = 0;
+      continue;
+    }
+    window.assign(history.begin(), history.end());
+    std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+    distances_.value[i] = window[window.size() / 2];
+  }
+  return true;
+}
+
+//Every ADC channel but the last carries an IR sensor, channels reading 10 or
+//less have nothing connected
+bool EddieProcessing::convertIR(const eddie_telemetry::Frame &frame)
+{
+  if (!frame.has_adc || frame.adc.empty())
+    return false;
+  voltages_.header.stamp = frame.adc_stamp;
+  voltages_.value.clear();
+  for (size_t i = 0; i + 1 < frame.adc.size(); i++)
+  {
+    if (frame.adc[i] > 10)
+      voltages_.value.push_back(frame.adc[i] / ADC_VOLTAGE_DIVIDER);
+  }
+  return true;
+}
+
+//The battery sits on the last ADC channel
+bool EddieProcessing::updateBattery(const eddie_telemetry::Frame &frame)
+{
+  if (!frame.has_adc || frame.adc.empty())
+    return false;
+  double voltage = frame.adc.back() / ADC_VOLTAGE_DIVIDER * BATTERY_VOLTAGE_MULTIPLIER;
+  if (battery_voltage_ < 0)
+    battery_voltage_ = voltage;
+  else
+    battery_voltage_ += battery_filter_ * (voltage - battery_voltage_);
+  battery_.value = battery_voltage_;
+  return true;
+}
+
+//Dead reckoning on the gyro heading, the wheel differential standing in for
+//cycles without one. The pose starts out facing the first gyro reading.
+bool EddieProcessing::updateOdometry(const eddie_telemetry::Frame &frame)
+{
+  if (!frame.has_encoders)
+    return false;
+  double heading = frame.heading * M_PI / 180;
+  if (!has_odometry_)
+  {
+    has_odometry_ = true;
+    dead_reckoning_.reset(0, 0, frame.has_heading ? heading : 0);
+  }
+  if (!dead_reckoning_.update(frame.left_ticks, frame.right_ticks, frame.has_heading, heading))
+  {
+    last_encoder_stamp_ = frame.encoder_stamp;
+    return false;
+  }
+
+  double dt = (frame.encoder_stamp - last_encoder_stamp_).toSec();
+  odometry_.header.stamp = frame.encoder_stamp;
+  odometry_.x = dead_reckoning_.x();
+  odometry_.y = dead_reckoning_.y();
+  odometry_.theta = dead_reckoning_.theta();
+  odometry_.linear = dt > 0 ? dead_reckoning_.distance() / dt : 0;
+  odometry_.angular = dt > 0 ? dead_reckoning_.turned() / dt : 0;
+  last_encoder_stamp_ = frame.encoder_stamp;
+  return true;
+}
+
+void EddieProcessing::report()
+{
+  double serial = 0;
+  char stages[256];
+  int length = 0;
+  for (int i = 0; i < STAGE_COUNT; i++)
+  {
+    serial += stage_time_[i];
+    length += snprintf(stages + length, sizeof (stages) - length, "%s%s %.1f us", i ? ", " : "", STAGE_NAMES[i],
+                       stage_time_[i] / frames_ * 1e6);
+    stage_time_[i] = 0;
+  }
+  ROS_INFO("Processing: %llu frames on %d threads, %s; %.1f us serial, %.1f us joined (%.2fx)",
+           (unsigned long long)frames_, pool_ ? pool_->size() : 0, stages, serial / frames_ * 1e6,
+           graph_time_ / frames_ * 1e6, graph_time_ > 0 ? serial / graph_time_ : 0);
+  frames_ = 0;
+  graph_time_ = 0;
+  last_report_ = ros::WallTime::now();
+}
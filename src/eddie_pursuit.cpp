@@ -0,0 +1,174 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_pursuit.h"
+#include <cmath>
+#include <algorithm>
+
+EddiePursuit::EddiePursuit() :
+  lookahead_(0.3),
+  max_speed_(0.3), max_angular_(1.0), max_lateral_accel_(0.2), max_decel_(0.3),
+  goal_tolerance_(0.05),
+  index_(0), travelled_(0), cross_track_error_(0)
+{
+}
+
+void EddiePursuit::setLookahead(double lookahead)
+{
+  lookahead_ = lookahead;
+}
+
+void EddiePursuit::setMaxSpeed(double max_speed)
+{
+  max_speed_ = max_speed;
+}
+
+void EddiePursuit::setLimits(double max_angular, double max_lateral_accel, double max_decel)
+{
+  max_angular_ = max_angular;
+  max_lateral_accel_ = max_lateral_accel;
+  max_decel_ = max_decel;
+}
+
+void EddiePursuit::setGoalTolerance(double tolerance)
+{
+  goal_tolerance_ = tolerance;
+}
+
+void EddiePursuit::setPath(const std::vector<Point> &path)
+{
+  path_ = path;
+  length_.assign(path_.size(), 0);
+  for (size_t i = 1; i < path_.size(); i++)
+    length_[i] = length_[i - 1] + hypot(path_[i].x - path_[i - 1].x, path_[i].y - path_[i - 1].y);
+  index_ = 0;
+  travelled_ = 0;
+  cross_track_error_ = 0;
+}
+
+bool EddiePursuit::update(double x, double y, double theta, double &linear, double &angular)
+{
+  linear = angular = 0;
+  if (path_.empty())
+    return false;
+
+  //the window reaches two lookaheads past the last projection, far enough to
+  //catch up after a shortcut but not to jump to a later pass nearby
+  double best = -1;
+  for (size_t i = index_; i + 1 < path_.size() && (i == index_ || length_[i] <= travelled_ + 2 * lookahead_); i++)
+  {
+    double sx = path_[i + 1].x - path_[i].x, sy = path_[i + 1].y - path_[i].y;
+    double segment = length_[i + 1] - length_[i];
+    double t = segment > 0 ? ((x - path_[i].x) * sx + (y - path_[i].y) * sy) / (segment * segment) : 0;
+    t = std::min(std::max(t, 0.0), 1.0);
+    double distance = hypot(path_[i].x + t * sx - x, path_[i].y + t * sy - y);
+    if (best < 0 || distance < best)
+    {
+      best = distance;
+      index_ = i;
+      travelled_ = length_[i] + t * segment;
+    }
+  }
+  if (best < 0)
+    best = hypot(path_[0].x - x, path_[0].y - y);
+  cross_track_error_ = best;
+
+  const Point &goal = path_.back();
+  double remaining = length_.back() - travelled_;
+  double goal_distance = hypot(goal.x - x, goal.y - y);
+  if (goal_distance <= goal_tolerance_ && remaining <= lookahead_)
+    return false;
+
+  Point target = pointAt(travelled_ + lookahead_);
+  double dx = target.x - x, dy = target.y - y;
+  double ahead = cos(theta) * dx + sin(theta) * dy;
+  double left = -sin(theta) * dx + cos(theta) * dy;
+
+  //no arc from the current heading reaches a point beside or behind the
+  //robot, so it first turns in place to face it
+  if (ahead <= 0)
+  {
+    angular = left >= 0 ? max_angular_ : -max_angular_;
+    return true;
+  }
+
+  double curvature = 2 * left / (ahead * ahead + left * left);
+  double speed = max_speed_;
+  if (curvature != 0 && max_lateral_accel_ > 0)
+    speed = std::min(speed, sqrt(max_lateral_accel_ / fabs(curvature)));
+  if (max_decel_ > 0)
+    speed = std::min(speed, sqrt(2 * max_decel_ * std::max(remaining, goal_distance)));
+  angular = speed * curvature;
+  if (fabs(angular) > max_angular_)
+  {
+    speed *= max_angular_ / fabs(angular);
+    angular = angular > 0 ? max_angular_ : -max_angular_;
+  }
+  linear = speed;
+  return true;
+}
+
+size_t EddiePursuit::index() const
+{
+  return index_;
+}
+
+double EddiePursuit::crossTrackError() const
+{
+  return cross_track_error_;
+}
+
+double EddiePursuit::progress() const
+{
+  if (path_.empty() || length_.back() <= 0)
+    return 1;
+  return std::min(1.0, travelled_ / length_.back());
+}
+
+//Point distance meters along the path, the last point past its end
+EddiePursuit::Point EddiePursuit::pointAt(double distance) const
+{
+  for (size_t i = index_; i + 1 < path_.size(); i++)
+  {
+    if (length_[i + 1] < distance)
+      continue;
+    double segment = length_[i + 1] - length_[i];
+    double t = segment > 0 ? (distance - length_[i]) / segment : 0;
+    Point point;
+    point.x = path_[i].x + t * (path_[i + 1].x - path_[i].x);
+    point.y = path_[i].y + t * (path_[i + 1].y - path_[i].y);
+    return point;
+  }
+  return path_.back();
+}
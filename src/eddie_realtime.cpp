@@ -0,0 +1,275 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_realtime.h"
+#include <cstring>
+#include <cerrno>
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+namespace eddie_realtime
+{
+
+Config readConfig(ros::NodeHandle &node_handle)
+{
+  Config config;
+  config.enabled = false;
+  config.priority = 80;
+  config.heap_prefault = 16;
+  config.report_period = 0;
+  node_handle.param("realtime_enabled", config.enabled, config.enabled);
+  node_handle.param("realtime_priority", config.priority, config.priority);
+  node_handle.param("realtime_heap_prefault", config.heap_prefault, config.heap_prefault);
+  node_handle.param("cycle_report_period", config.report_period, config.report_period);
+
+  XmlRpc::XmlRpcValue cpus;
+  if (node_handle.getParam("realtime_cpus", cpus) && cpus.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int i = 0; i < cpus.size(); i++)
+      config.cpus.push_back(static_cast<int>(cpus[i]));
+  }
+  return config;
+}
+
+static void prefaultStack()
+{
+  unsigned char stack[256 * 1024];
+  memset(stack, 0, sizeof (stack));
+  __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+bool lockMemory(int heap_prefault)
+{
+  //freed memory stays in the process instead of being trimmed or unmapped
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    ROS_ERROR("ERROR: Unable to lock memory: %s", strerror(errno));
+    return false;
+  }
+  prefaultStack();
+
+  //touch and free a block so the heap is already grown and resident
+  size_t size = (size_t)heap_prefault << 20;
+  if (size > 0)
+  {
+    char* heap = (char*)malloc(size);
+    if (heap)
+    {
+      for (size_t i = 0; i < size; i += 4096)
+        heap[i] = 0;
+      free(heap);
+    }
+  }
+  return true;
+}
+
+bool configureThread(pthread_t thread, int priority, const std::vector<int> &cpus, const char* name)
+{
+  bool configured = true;
+  struct sched_param param;
+  memset(&param, 0, sizeof (param));
+  param.sched_priority = priority;
+  int error = pthread_setschedparam(thread, SCHED_FIFO, &param);
+  if (error != 0)
+  {
+    ROS_ERROR("ERROR: Unable to run the %s thread SCHED_FIFO at priority %d: %s", name, priority, strerror(error));
+    configured = false;
+  }
+
+  if (!cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++)
+      CPU_SET(cpus[i], &set);
+    error = pthread_setaffinity_np(thread, sizeof (set), &set);
+    if (error != 0)
+    {
+      ROS_ERROR("ERROR: Unable to pin the %s thread: %s", name, strerror(error));
+      configured = false;
+    }
+  }
+  return configured;
+}
+
+PriorityMutex::PriorityMutex()
+{
+  pthread_mutexattr_t attributes;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_setprotocol(&attributes, PTHREAD_PRIO_INHERIT);
+  pthread_mutex_init(&mutex_, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+}
+
+PriorityMutex::~PriorityMutex()
+{
+  pthread_mutex_destroy(&mutex_);
+}
+
+void PriorityMutex::lock()
+{
+  pthread_mutex_lock(&mutex_);
+}
+
+void PriorityMutex::unlock()
+{
+  pthread_mutex_unlock(&mutex_);
+}
+
+double monotonicNow()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void sleepUntil(double deadline)
+{
+  struct timespec until;
+  until.tv_sec = (time_t)deadline;
+  until.tv_nsec = (long)((deadline - until.tv_sec) * 1e9);
+  if (until.tv_nsec >= 1000000000)
+  {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR);
+}
+
+MonotonicCondition::MonotonicCondition()
+{
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&condition_, &attributes);
+  pthread_condattr_destroy(&attributes);
+}
+
+MonotonicCondition::~MonotonicCondition()
+{
+  pthread_cond_destroy(&condition_);
+}
+
+bool MonotonicCondition::waitUntil(boost::mutex::scoped_lock &lock, double deadline)
+{
+  struct timespec until;
+  until.tv_sec = (time_t)deadline;
+  until.tv_nsec = (long)((deadline - until.tv_sec) * 1e9);
+  if (until.tv_nsec >= 1000000000)
+  {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+  //boost::mutex is a plain pthread mutex underneath
+  return pthread_cond_timedwait(&condition_, lock.mutex()->native_handle(), &until) != ETIMEDOUT;
+}
+
+void MonotonicCondition::notifyOne()
+{
+  pthread_cond_signal(&condition_);
+}
+
+void MonotonicCondition::notifyAll()
+{
+  pthread_cond_broadcast(&condition_);
+}
+
+CycleStats::CycleStats(const char* name, double deadline, double report_period) :
+  name_(name), deadline_(deadline), report_period_(report_period)
+{
+  reset();
+}
+
+void CycleStats::configure(double deadline, double report_period)
+{
+  deadline_ = deadline;
+  report_period_ = report_period;
+}
+
+void CycleStats::reset()
+{
+  window_start_ = ros::WallTime::now();
+  cycles_ = misses_ = 0;
+  lateness_sum_ = lateness_max_ = duration_max_ = 0;
+  memset(histogram_, 0, sizeof (histogram_));
+}
+
+void CycleStats::record(double lateness, double duration)
+{
+  if (lateness < 0)
+    lateness = 0;
+  cycles_++;
+  lateness_sum_ += lateness;
+  if (lateness > lateness_max_)
+    lateness_max_ = lateness;
+  if (duration > duration_max_)
+    duration_max_ = duration;
+  if (deadline_ > 0 && lateness + duration > deadline_)
+    misses_++;
+
+  int bucket = 0;
+  for (uint64_t us = (uint64_t)(lateness * 1e6); us > 0 && bucket < BUCKETS - 1; us >>= 1)
+    bucket++;
+  histogram_[bucket]++;
+
+  if (report_period_ <= 0)
+    return;
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - window_start_).toSec() < report_period_)
+    return;
+  ROS_INFO("%s: %llu cycles, jitter mean %.3f ms p99 < %.3f ms max %.3f ms, work max %.3f ms, %llu deadline misses",
+           name_, (unsigned long long)cycles_, lateness_sum_ / cycles_ * 1000, percentile(0.99) * 1000,
+           lateness_max_ * 1000, duration_max_ * 1000, (unsigned long long)misses_);
+  reset();
+}
+
+//Upper bound of the bucket holding the given fraction of the samples
+double CycleStats::percentile(double fraction) const
+{
+  uint64_t target = (uint64_t)(cycles_ * fraction), seen = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++)
+  {
+    seen += histogram_[bucket];
+    if (seen > target)
+      return (1 << bucket) / 1e6;
+  }
+  return lateness_max_;
+}
+
+}
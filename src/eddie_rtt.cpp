@@ -0,0 +1,77 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_rtt.h"
+#include <cmath>
+#include <algorithm>
+
+EddieRTT::EddieRTT() :
+  srtt_(0), rttvar_(0),
+  initial_(0.08), min_(0.01), max_(0.5),
+  primed_(false)
+{
+}
+
+void EddieRTT::setLimits(double initial, double min, double max)
+{
+  initial_ = initial;
+  min_ = min;
+  max_ = max;
+}
+
+void EddieRTT::update(double rtt)
+{
+  if (!primed_)
+  {
+    srtt_ = rtt;
+    rttvar_ = rtt / 2;
+    primed_ = true;
+    return;
+  }
+  //gains of 1/8 and 1/4 as in RFC 6298
+  rttvar_ = 0.75 * rttvar_ + 0.25 * fabs(srtt_ - rtt);
+  srtt_ = 0.875 * srtt_ + 0.125 * rtt;
+}
+
+double EddieRTT::timeout(int attempt) const
+{
+  double rto = primed_ ? srtt_ + 4 * rttvar_ : initial_;
+  rto = std::max(min_, std::min(max_, rto));
+  return std::min(max_, rto * (1 << std::min(attempt, 8)));
+}
+
+double EddieRTT::smoothed() const
+{
+  return primed_ ? srtt_ : initial_;
+}
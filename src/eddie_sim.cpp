@@ -0,0 +1,318 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_sim.h"
+#include "eddie_commands.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace eddie_commands;
+
+//Arguments arrive as masked hex without leading zeros, so the field width
+//comes from the command table to restore the sign
+template <class F>
+static long argument(const std::vector<std::string> &tokens, size_t index)
+{
+  if (index >= tokens.size())
+    return 0;
+  long value = strtol(tokens[index].c_str(), NULL, 16);
+  if (F::SIGNED && value >= (1L << (F::WIDTH * 4 - 1)))
+    value -= 1L << (F::WIDTH * 4);
+  return value;
+}
+
+template <class F>
+static std::string field(long value)
+{
+  char buffer[16];
+  unsigned long masked = (unsigned long)value & ((1UL << (F::WIDTH * 4)) - 1);
+  snprintf(buffer, sizeof (buffer), "%0*lX", (int)F::WIDTH, masked);
+  return buffer;
+}
+
+EddieSim::EddieSim() :
+  BAUD_RATE(115200),
+  DEGREES_PER_TICK(2.5)
+{
+  int board_count = 1;
+  std::string prefix = "/tmp/eddie_sim";
+  node_handle_.param("sim_board_count", board_count, board_count);
+  node_handle_.param<std::string>("sim_port_prefix", prefix, prefix);
+
+  for (int i = 0; i < board_count; i++)
+    openBoard(i, prefix);
+}
+
+EddieSim::~EddieSim()
+{
+  for (size_t i = 0; i < boards_.size(); i++)
+  {
+    unlink(boards_[i].link.c_str());
+    close(boards_[i].fd);
+  }
+}
+
+void EddieSim::openBoard(int index, std::string prefix)
+{
+  Board board;
+  board.fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (board.fd < 0 || grantpt(board.fd) < 0 || unlockpt(board.fd) < 0)
+  {
+    ROS_ERROR("ERROR: Unable to create a pseudo terminal for simulated board %d", index);
+    if (board.fd >= 0)
+      close(board.fd);
+    return;
+  }
+
+  //raw mode so that carriage returns reach us untranslated
+  struct termios tio;
+  tcgetattr(board.fd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(board.fd, TCSANOW, &tio);
+
+  std::stringstream link;
+  link << prefix << index;
+  board.link = link.str();
+  unlink(board.link.c_str());
+  if (symlink(ptsname(board.fd), board.link.c_str()) < 0)
+    ROS_ERROR("ERROR: Unable to link %s to %s", board.link.c_str(), ptsname(board.fd));
+
+  board.left_speed = board.right_speed = 0;
+  board.left_distance = board.right_distance = 0;
+  board.left_target = board.right_target = 0;
+  board.positioning = false;
+  board.gpio_state = 0;
+  board.updated = ros::WallTime::now();
+  boards_.push_back(board);
+  ROS_INFO("Simulated board %d on %s", index, board.link.c_str());
+}
+
+void EddieSim::spin()
+{
+  std::vector<struct pollfd> fds(boards_.size());
+  for (size_t i = 0; i < boards_.size(); i++)
+  {
+    fds[i].fd = boards_[i].fd;
+    fds[i].events = POLLIN;
+  }
+  std::vector<ros::WallTime> hung_until(boards_.size());
+
+  while (ros::ok())
+  {
+    //wake up for the earliest response that is due, or every 100ms
+    ros::WallTime now = ros::WallTime::now();
+    int timeout = 100;
+    for (size_t i = 0; i < boards_.size(); i++)
+    {
+      if (fds[i].fd < 0 && hung_until[i] <= now)
+        fds[i].fd = boards_[i].fd;
+    }
+    for (size_t i = 0; i < boards_.size(); i++)
+    {
+      if (boards_[i].outgoing.empty())
+        continue;
+      int remaining = (int)ceil((boards_[i].due - now).toSec() * 1000);
+      timeout = std::max(0, std::min(timeout, remaining));
+    }
+
+    if (poll(&fds[0], fds.size(), timeout) < 0)
+      continue;
+
+    now = ros::WallTime::now();
+    for (size_t i = 0; i < fds.size(); i++)
+    {
+      Board &board = boards_[i];
+      if (!board.outgoing.empty() && board.due <= now)
+      {
+        if (write(board.fd, board.outgoing.data(), board.outgoing.size()) < 0)
+          ROS_ERROR("ERROR: Unable to write to %s", board.link.c_str());
+        board.outgoing.clear();
+      }
+
+      //POLLHUP just means the driver has not opened the port yet; poll keeps
+      //reporting it at once, so leave the board out for a while to not spin
+      if (fds[i].revents & POLLHUP && !(fds[i].revents & POLLIN))
+      {
+        fds[i].fd = -1;
+        hung_until[i] = now + ros::WallDuration(0.1);
+      }
+      if (!(fds[i].revents & POLLIN))
+        continue;
+
+      char buffer[256];
+      ssize_t n = read(fds[i].fd, buffer, sizeof (buffer));
+      for (ssize_t j = 0; j < n; j++)
+      {
+        if (buffer[j] != PACKET_TERMINATOR)
+        {
+          board.line += buffer[j];
+          continue;
+        }
+        //the extra carriage returns of a buffer flush are ignored
+        if (board.line.empty())
+          continue;
+        update(board);
+        reply(board, respond(board, board.line));
+        board.line.clear();
+      }
+    }
+  }
+}
+
+//Advances the wheels to now, stopping TRVL and TURN moves at their target
+void EddieSim::update(Board &board)
+{
+  ros::WallTime now = ros::WallTime::now();
+  double dt = (now - board.updated).toSec();
+  board.updated = now;
+
+  board.left_distance += board.left_speed * dt;
+  board.right_distance += board.right_speed * dt;
+  if (board.positioning &&
+      (board.left_speed > 0 ? board.left_distance >= board.left_target : board.left_distance <= board.left_target))
+  {
+    board.left_distance = board.left_target;
+    board.right_distance = board.right_target;
+    board.left_speed = board.right_speed = 0;
+    board.positioning = false;
+  }
+}
+
+std::string EddieSim::respond(Board &board, const std::string &line)
+{
+  std::vector<std::string> tokens;
+  std::stringstream stream(line);
+  std::string token;
+  while (stream >> token)
+    tokens.push_back(token);
+  if (tokens.empty())
+    return "ERROR";
+
+  const std::string &opcode = tokens[0];
+  std::string response;
+
+  if (opcode == Ver::opcode())
+    response = field<Ver::Reply::Field>(0x10);
+  else if (opcode == Ping::opcode())
+  {
+    //two ping sensors looking at a wall that recedes as the robot backs off
+    long distance = 1000 - (long)((board.left_distance + board.right_distance) / 2) % 800;
+    response = field<Ping::Reply::Field>(distance) + PARAMETER_DELIMITER + field<Ping::Reply::Field>(distance + 20);
+  }
+  else if (opcode == Adc::opcode())
+  {
+    for (int i = 0; i < Adc::Reply::COUNT; i++)
+      response += (i ? std::string(1, PARAMETER_DELIMITER) : std::string()) + field<Adc::Reply::Field>(i == Adc::Reply::COUNT - 1 ? 3000 : 800);
+  }
+  else if (opcode == Read::opcode())
+    response = field<Read::Reply::Field>(board.gpio_state);
+  else if (opcode == Spd::opcode())
+    response = field<Spd::Reply::Field>(lround(board.left_speed)) + PARAMETER_DELIMITER + field<Spd::Reply::Field>(lround(board.right_speed));
+  else if (opcode == Dist::opcode())
+    response = field<Dist::Reply::Field>(lround(board.left_distance)) + PARAMETER_DELIMITER + field<Dist::Reply::Field>(lround(board.right_distance));
+  else if (opcode == Head::opcode())
+  {
+    long heading = lround((board.right_distance - board.left_distance) * DEGREES_PER_TICK / 2) % 360;
+    response = field<Head::Reply::Field>(heading < 0 ? heading + 360 : heading);
+  }
+  else if (opcode == High::opcode())
+    board.gpio_state |= argument<High::Args::First>(tokens, 1);
+  else if (opcode == Low::opcode())
+    board.gpio_state &= ~argument<Low::Args::First>(tokens, 1);
+  else if (opcode == Out::opcode() || opcode == In::opcode() || opcode == Acc::opcode())
+  {
+  }
+  else if (opcode == Go::opcode())
+  {
+    //roughly half a tick per second for each unit of power
+    board.left_speed = argument<Go::Args::First>(tokens, 1) * 0.5;
+    board.right_speed = argument<Go::Args::Second>(tokens, 2) * 0.5;
+    board.positioning = false;
+  }
+  else if (opcode == GoSpd::opcode())
+  {
+    board.left_speed = argument<GoSpd::Args::First>(tokens, 1);
+    board.right_speed = argument<GoSpd::Args::Second>(tokens, 2);
+    board.positioning = false;
+  }
+  else if (opcode == Trvl::opcode() || opcode == Turn::opcode())
+  {
+    long amount = argument<Trvl::Args::First>(tokens, 1);
+    double speed = argument<Trvl::Args::Second>(tokens, 2);
+    double ticks = opcode == Trvl::opcode() ? amount : amount / DEGREES_PER_TICK;
+    double sign = ticks < 0 ? -1 : 1;
+    board.left_target = board.left_distance + (opcode == Trvl::opcode() ? ticks : -ticks);
+    board.right_target = board.right_distance + ticks;
+    board.left_speed = (opcode == Trvl::opcode() ? sign : -sign) * speed;
+    board.right_speed = sign * speed;
+    board.positioning = ticks != 0 && speed > 0;
+    if (!board.positioning)
+      board.left_speed = board.right_speed = 0;
+  }
+  else if (opcode == Stop::opcode())
+  {
+    board.left_speed = board.right_speed = 0;
+    board.positioning = false;
+  }
+  else if (opcode == Rst::opcode())
+    board.left_distance = board.right_distance = 0;
+  else
+    return "ERROR";
+
+  return response;
+}
+
+//Queues the response for as long as the exchange would take on the wire
+void EddieSim::reply(Board &board, const std::string &response)
+{
+  double bytes = board.line.size() + 1 + response.size() + 1;
+  board.outgoing += response + PACKET_TERMINATOR;
+  board.due = ros::WallTime::now() + ros::WallDuration(bytes * 10 / BAUD_RATE);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "eddie_sim");
+  EddieSim sim;
+  sim.spin();
+
+  return 0;
+}
@@ -0,0 +1,342 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_telemetry.h"
+
+namespace eddie_telemetry
+{
+
+namespace
+{
+
+//Presence bits of the groups in a frame
+enum
+{
+  PING = 1,
+  ADC = 2,
+  ENCODERS = 4,
+  HEADING = 8
+};
+
+//Bits used to send the width of a group: widths go up to 33 for the
+//difference of two int32 encoder counts
+const int WIDTH_BITS = 6;
+const int COUNT_BITS = 4;
+
+class BitWriter
+{
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) :
+    out_(out), accumulator_(0), bits_(0)
+  {
+    out_.clear();
+  }
+
+  void write(uint64_t value, int bits)
+  {
+    for (int i = 0; i < bits; i++)
+    {
+      accumulator_ |= ((value >> i) & 1) << bits_;
+      if (++bits_ == 8)
+      {
+        out_.push_back(accumulator_);
+        accumulator_ = 0;
+        bits_ = 0;
+      }
+    }
+  }
+
+  void flush()
+  {
+    if (bits_ > 0)
+      out_.push_back(accumulator_);
+    accumulator_ = 0;
+    bits_ = 0;
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint8_t accumulator_;
+  int bits_;
+};
+
+class BitReader
+{
+public:
+  explicit BitReader(const std::vector<uint8_t> &in) :
+    in_(in), position_(0)
+  {
+  }
+
+  //Returns false once the data runs out
+  bool read(uint64_t &value, int bits)
+  {
+    value = 0;
+    for (int i = 0; i < bits; i++)
+    {
+      if (position_ >= in_.size() * 8)
+        return false;
+      value |= (uint64_t)((in_[position_ / 8] >> (position_ % 8)) & 1) << i;
+      position_++;
+    }
+    return true;
+  }
+
+private:
+  const std::vector<uint8_t> &in_;
+  size_t position_;
+};
+
+inline uint64_t zigzag(int64_t value)
+{
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value)
+{
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+//Writes the values with the width of the largest one
+void writeGroup(BitWriter &writer, const std::vector<int64_t> &values)
+{
+  uint64_t largest = 0;
+  for (size_t i = 0; i < values.size(); i++)
+    largest |= zigzag(values[i]);
+  int width = 0;
+  while (width < 64 && (largest >> width))
+    width++;
+  writer.write(width, WIDTH_BITS);
+  for (size_t i = 0; i < values.size(); i++)
+    writer.write(zigzag(values[i]), width);
+}
+
+bool readGroup(BitReader &reader, size_t count, std::vector<int64_t> &values)
+{
+  uint64_t width;
+  if (!reader.read(width, WIDTH_BITS))
+    return false;
+  values.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    uint64_t value;
+    if (!reader.read(value, width))
+      return false;
+    values[i] = unzigzag(value);
+  }
+  return true;
+}
+
+void writeStamp(BitWriter &writer, ros::Time stamp, ros::Time reference)
+{
+  std::vector<int64_t> offset(1, ((int64_t)stamp.toNSec() - (int64_t)reference.toNSec()) / 1000);
+  writeGroup(writer, offset);
+}
+
+bool readStamp(BitReader &reader, ros::Time reference, ros::Time &stamp)
+{
+  std::vector<int64_t> offset;
+  if (!readGroup(reader, 1, offset))
+    return false;
+  stamp.fromNSec(reference.toNSec() + offset[0] * 1000);
+  return true;
+}
+
+void writeValues(BitWriter &writer, const std::vector<uint16_t> &values, const std::vector<uint16_t> &previous)
+{
+  std::vector<int64_t> deltas(values.size());
+  for (size_t i = 0; i < values.size(); i++)
+    deltas[i] = (int64_t)values[i] - (i < previous.size() ? previous[i] : 0);
+  writer.write(values.size(), COUNT_BITS);
+  writeGroup(writer, deltas);
+}
+
+bool readValues(BitReader &reader, const std::vector<uint16_t> &previous, std::vector<uint16_t> &values)
+{
+  uint64_t count;
+  std::vector<int64_t> deltas;
+  if (!reader.read(count, COUNT_BITS) || !readGroup(reader, count, deltas))
+    return false;
+  values.resize(count);
+  for (size_t i = 0; i < count; i++)
+    values[i] = (uint16_t)((i < previous.size() ? previous[i] : 0) + deltas[i]);
+  return true;
+}
+
+//Headings wrap at 360, so the shorter way round is sent
+int64_t headingDelta(uint16_t heading, uint16_t previous)
+{
+  int64_t delta = ((int64_t)heading - previous) % 360;
+  if (delta >= 180)
+    delta -= 360;
+  else if (delta < -180)
+    delta += 360;
+  return delta;
+}
+
+}
+
+Frame::Frame() :
+  has_ping(false), has_adc(false),
+  has_encoders(false), left_ticks(0), right_ticks(0),
+  has_heading(false), heading(0)
+{
+}
+
+Encoder::Encoder(int keyframe_interval) :
+  keyframe_interval_(keyframe_interval < 1 ? 1 : keyframe_interval), sequence_(0)
+{
+}
+
+void Encoder::encode(const Frame &frame, parallax_eddie_robot::CompactTelemetry &message)
+{
+  bool keyframe = sequence_ % keyframe_interval_ == 0;
+  if (keyframe)
+    previous_ = Frame();
+
+  message.sequence = sequence_++;
+  message.stamp = frame.stamp;
+  message.flags = keyframe ? (uint8_t)parallax_eddie_robot::CompactTelemetry::KEYFRAME : 0;
+
+  BitWriter writer(message.data);
+  writer.write((frame.has_ping ? PING : 0) | (frame.has_adc ? ADC : 0) |
+               (frame.has_encoders ? ENCODERS : 0) | (frame.has_heading ? HEADING : 0), 4);
+  if (frame.has_ping)
+  {
+    writeStamp(writer, frame.ping_stamp, frame.stamp);
+    writeValues(writer, frame.ping, previous_.ping);
+    previous_.ping = frame.ping;
+  }
+  if (frame.has_adc)
+  {
+    writeStamp(writer, frame.adc_stamp, frame.stamp);
+    writeValues(writer, frame.adc, previous_.adc);
+    previous_.adc = frame.adc;
+  }
+  if (frame.has_encoders)
+  {
+    std::vector<int64_t> deltas(2);
+    deltas[0] = (int64_t)frame.left_ticks - previous_.left_ticks;
+    deltas[1] = (int64_t)frame.right_ticks - previous_.right_ticks;
+    writeStamp(writer, frame.encoder_stamp, frame.stamp);
+    writeGroup(writer, deltas);
+    previous_.left_ticks = frame.left_ticks;
+    previous_.right_ticks = frame.right_ticks;
+  }
+  if (frame.has_heading)
+  {
+    std::vector<int64_t> delta(1, headingDelta(frame.heading, previous_.heading));
+    writeStamp(writer, frame.heading_stamp, frame.stamp);
+    writeGroup(writer, delta);
+    previous_.heading = frame.heading;
+  }
+  writer.flush();
+}
+
+Decoder::Decoder() :
+  synchronized_(false), next_sequence_(0), lost_(0)
+{
+}
+
+uint32_t Decoder::lost() const
+{
+  return lost_;
+}
+
+bool Decoder::decode(const parallax_eddie_robot::CompactTelemetry &message, Frame &frame)
+{
+  bool keyframe = message.flags & parallax_eddie_robot::CompactTelemetry::KEYFRAME;
+  if (synchronized_ && message.sequence != next_sequence_)
+  {
+    lost_ += message.sequence - next_sequence_;
+    synchronized_ = false;
+  }
+  next_sequence_ = message.sequence + 1;
+  if (keyframe)
+  {
+    previous_ = Frame();
+    synchronized_ = true;
+  }
+  if (!synchronized_)
+    return false;
+
+  frame = Frame();
+  frame.stamp = message.stamp;
+  BitReader reader(message.data);
+  uint64_t groups;
+  bool ok = reader.read(groups, 4);
+  if (ok && (groups & PING))
+  {
+    frame.has_ping = true;
+    ok = readStamp(reader, frame.stamp, frame.ping_stamp) && readValues(reader, previous_.ping, frame.ping);
+    previous_.ping = frame.ping;
+  }
+  if (ok && (groups & ADC))
+  {
+    frame.has_adc = true;
+    ok = readStamp(reader, frame.stamp, frame.adc_stamp) && readValues(reader, previous_.adc, frame.adc);
+    previous_.adc = frame.adc;
+  }
+  if (ok && (groups & ENCODERS))
+  {
+    std::vector<int64_t> deltas;
+    frame.has_encoders = true;
+    ok = readStamp(reader, frame.stamp, frame.encoder_stamp) && readGroup(reader, 2, deltas);
+    if (ok)
+    {
+      frame.left_ticks = (int32_t)(previous_.left_ticks + deltas[0]);
+      frame.right_ticks = (int32_t)(previous_.right_ticks + deltas[1]);
+      previous_.left_ticks = frame.left_ticks;
+      previous_.right_ticks = frame.right_ticks;
+    }
+  }
+  if (ok && (groups & HEADING))
+  {
+    std::vector<int64_t> delta;
+    frame.has_heading = true;
+    ok = readStamp(reader, frame.stamp, frame.heading_stamp) && readGroup(reader, 1, delta);
+    if (ok)
+    {
+      frame.heading = (uint16_t)(((previous_.heading + delta[0]) % 360 + 360) % 360);
+      previous_.heading = frame.heading;
+    }
+  }
+
+  //a corrupt frame leaves the state unknown until the next keyframe
+  if (!ok)
+    synchronized_ = false;
+  return ok;
+}
+
+}
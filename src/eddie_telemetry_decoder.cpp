@@ -0,0 +1,98 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_telemetry_decoder.h"
+
+EddieTelemetryDecoder::EddieTelemetryDecoder() :
+  reported_lost_(0)
+{
+  std::string telemetry_topic = "/eddie/telemetry";
+  std::string output_namespace = "/eddie_remote";
+  node_handle_.param<std::string>("telemetry_topic", telemetry_topic, telemetry_topic);
+  node_handle_.param<std::string>("output_namespace", output_namespace, output_namespace);
+
+  ping_pub_ = node_handle_.advertise<parallax_eddie_robot::Ping > (output_namespace + "/ping_data", 1);
+  adc_pub_ = node_handle_.advertise<parallax_eddie_robot::ADC > (output_namespace + "/adc_data", 1);
+  odometry_pub_ = node_handle_.advertise<parallax_eddie_robot::WheelOdometry > (output_namespace + "/wheel_odometry", 1);
+  telemetry_sub_ = node_handle_.subscribe(telemetry_topic, 10, &EddieTelemetryDecoder::telemetryCallback, this);
+}
+
+void EddieTelemetryDecoder::telemetryCallback(const parallax_eddie_robot::CompactTelemetry::ConstPtr& message)
+{
+  eddie_telemetry::Frame frame;
+  bool decoded = decoder_.decode(*message, frame);
+  if (decoder_.lost() != reported_lost_)
+  {
+    ROS_WARN("Lost %u telemetry frame(s), waiting for the next keyframe", decoder_.lost() - reported_lost_);
+    reported_lost_ = decoder_.lost();
+  }
+  if (!decoded)
+    return;
+
+  if (frame.has_ping)
+  {
+    parallax_eddie_robot::Ping ping_data;
+    ping_data.header.stamp = frame.ping_stamp;
+    ping_data.status = "SUCCESS";
+    ping_data.value = frame.ping;
+    ping_pub_.publish(ping_data);
+  }
+  if (frame.has_adc)
+  {
+    parallax_eddie_robot::ADC adc_data;
+    adc_data.header.stamp = frame.adc_stamp;
+    adc_data.status = "SUCCESS";
+    adc_data.value = frame.adc;
+    adc_pub_.publish(adc_data);
+  }
+  if (frame.has_encoders || frame.has_heading)
+  {
+    parallax_eddie_robot::WheelOdometry odometry;
+    odometry.header.stamp = frame.encoder_stamp;
+    odometry.left_ticks = frame.left_ticks;
+    odometry.right_ticks = frame.right_ticks;
+    odometry.heading_stamp = frame.heading_stamp;
+    odometry.heading = frame.heading;
+    odometry_pub_.publish(odometry);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "eddie_telemetry_decoder");
+  EddieTelemetryDecoder decoder;
+  ros::spin();
+
+  return 0;
+}
@@ -33,21 +33,93 @@
  */
 
 #include "eddie_teleop.h"
+#include "eddie_probes.h"
+#include <errno.h>
+#include <cmath>
+#include <algorithm>
 
 EddieTeleop::EddieTeleop() :
-  linear_(0), angular_(0), l_scale_(2.0), a_scale_(2.0)
+  linear_(0), angular_(0), l_scale_(2.0), a_scale_(2.0), repeat_rate_(10.0), release_timeout_(0.6),
+  trace_enabled_(false), trace_id_(0)
 {
   velocity_pub_ = node_handle_.advertise<parallax_eddie_robot::Velocity > ("/eddie/command_velocity", 1);
   keystroke_pub_ = node_handle_.advertise<parallax_eddie_robot::KeyStroke > ("/eddie/key_stroke", 1);
+  trace_pub_ = node_handle_.advertise<parallax_eddie_robot::TraceEvent > ("/eddie/trace", 100);
 
   node_handle_.param("scale_angular", a_scale_, a_scale_);
   node_handle_.param("scale_linear", l_scale_, l_scale_);
+  //while a key is held the velocity is republished at teleop_repeat_rate; the
+  //key counts as released once the terminal autorepeat has been silent for
+  //teleop_release_timeout, which must exceed the autorepeat delay
+  node_handle_.param("teleop_repeat_rate", repeat_rate_, repeat_rate_);
+  node_handle_.param("teleop_release_timeout", release_timeout_, release_timeout_);
+  node_handle_.param("trace_enabled", trace_enabled_, trace_enabled_);
+}
+
+//Sets linear_ and angular_ for a key, returns false and leaves them untouched
+//if the key is not bound
+bool EddieTeleop::keyToVelocity(char c)
+{
+  double linear = 0, angular = 0;
+  switch (c)
+  {
+    case KEYCODE_L:
+      ROS_DEBUG("LEFT");
+      angular = -45;
+      //linear = 1.0; //to test movement with linear and angular
+      break;
+    case KEYCODE_R:
+      ROS_DEBUG("RIGHT");
+      angular = 45;
+      //linear = 1.0; //to test movement with linear and angular
+      break;
+    case KEYCODE_U:
+      ROS_DEBUG("UP");
+      linear = 1.0;
+      break;
+    case KEYCODE_D:
+      ROS_DEBUG("DOWN");
+      linear = -1.0;
+      break;
+    case ' ':
+      ROS_DEBUG("STOP");
+      break;
+    default:
+      return false;
+  }
+  linear_ = linear;
+  angular_ = angular;
+  return true;
+}
+
+//Every published velocity starts a new trace, originating at the key read
+void EddieTeleop::publishVelocity(ros::Time origin)
+{
+  parallax_eddie_robot::Velocity vel;
+  vel.angular = a_scale_ * angular_;
+  vel.linear = l_scale_ * linear_;
+  vel.trace.id = ++trace_id_;
+  vel.trace.origin = origin;
+  velocity_pub_.publish(vel);
+  if (trace_enabled_)
+  {
+    trace(vel.trace, parallax_eddie_robot::TraceEvent::KEY_READ, origin);
+    trace(vel.trace, parallax_eddie_robot::TraceEvent::TELEOP_PUBLISH, ros::Time::now());
+  }
+}
+
+void EddieTeleop::trace(const parallax_eddie_robot::Trace &trace, uint8_t stage, ros::Time stamp)
+{
+  parallax_eddie_robot::TraceEvent event;
+  event.trace = trace;
+  event.stage = stage;
+  event.stamp = stamp;
+  trace_pub_.publish(event);
 }
 
 void EddieTeleop::keyLoop()
 {
   char c, cb;
-  bool move = false;
 
   //get the console in raw mode
   tcgetattr(kfd, &cooked);
@@ -67,66 +139,101 @@ void EddieTeleop::keyLoop()
   ROS_INFO("=====================");
   ROS_INFO("Use arrow keys to navigate");
 
-  while (true)
+  //key currently held down, 0 if none
+  char held = 0;
+  ros::WallTime last_key, last_publish;
+  ros::WallDuration repeat_period(1.0 / repeat_rate_);
+  ros::WallDuration release_timeout(release_timeout_);
+  struct pollfd pfd;
+  pfd.fd = kfd;
+  pfd.events = POLLIN;
+
+  while (ros::ok())
   {
-    cb = -1;
-    usleep(100000); //in microseconds
-    //get the next event from the keyboard
-    //by getting the very last value stored in the keyboard buffer
-    while (read(kfd, &c, 1) >= 0)
+    //sleep until a key arrives or the held key is due for a repeat or release
+    int timeout = -1;
+    if (held)
+    {
+      ros::WallTime now = ros::WallTime::now();
+      ros::WallTime next = std::min(last_publish + repeat_period, last_key + release_timeout);
+      timeout = next > now ? (int)ceil((next - now).toSec() * 1000) : 0;
+    }
+    int ready = poll(&pfd, 1, timeout);
+    ros::WallTime now = ros::WallTime::now();
+    ros::Time origin = ros::Time::now();
+    if (ready < 0)
     {
-      cb = c;
+      if (errno == EINTR)
+        continue;
+      ROS_ERROR("ERROR: unable to poll the keyboard");
+      break;
     }
-    c = cb;
 
-    linear_ = angular_ = 0;
-    //ROS_INFO("value: 0x%02X\n", c);
-    //ROS_INFO("KEY PRESSED: %s", &c);
-    switch (c)
+    if (ready > 0)
     {
-      case KEYCODE_L:
-        ROS_DEBUG("LEFT");
-        angular_ = -45;
-        //linear_ = 1.0; //to test movement with linear and angular
-        move = true;
-        break;
-      case KEYCODE_R:
-        ROS_DEBUG("RIGHT");
-        angular_ = 45;
-        //linear_ = 1.0; //to test movement with linear and angular
-        move = true;
-        break;
-      case KEYCODE_U:
-        ROS_DEBUG("UP");
-        linear_ = 1.0;
-        move = true;
-        break;
-      case KEYCODE_D:
-        ROS_DEBUG("DOWN");
-        linear_ = -1.0;
-        move = true;
-        break;
-      case ' ':
-        ROS_DEBUG("STOP");
-        linear_ = 0;
-        move = true;
+      //use the very last value stored in the keyboard buffer
+      cb = -1;
+      ssize_t count;
+      while ((count = read(kfd, &c, 1)) > 0)
+      {
+        cb = c;
+      }
+      c = cb;
+      //stdin closed or hung up: poll() would keep reporting it ready
+      bool closed = count == 0 || (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+          || (c == -1 && (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)));
+
+      if (c != -1)
+      {
+        if (keyToVelocity(c))
+        {
+          //space is a one-off stop, arrows are held
+          bool key_down = c != held;
+          held = c == ' ' ? 0 : c;
+          last_key = now;
+          if (key_down)
+          {
+            publishVelocity(origin);
+            last_publish = ros::WallTime::now();
+            EDDIE_PROBE2(key__publish, c, (last_publish - now).toNSec());
+            ROS_DEBUG("Key to publish latency: %.3f ms", (last_publish - now).toSec() * 1000);
+          }
+        }
+        parallax_eddie_robot::KeyStroke key;
+        key.keycode = c;
+        keystroke_pub_.publish(key);
+      }
+
+      //stop the robot and give up on the keyboard instead of spinning
+      if (closed)
+      {
+        ROS_WARN("Keyboard input closed, stopping");
+        if (held)
+        {
+          linear_ = angular_ = 0;
+          publishVelocity(origin);
+        }
         break;
+      }
     }
 
-    if (move)
+    if (held)
     {
-      parallax_eddie_robot::Velocity vel;
-      vel.angular = a_scale_ * angular_;
-      vel.linear = l_scale_ * linear_;
-      velocity_pub_.publish(vel);
-      move = false;
-    }
-    if(c!=-1){
-      parallax_eddie_robot::KeyStroke key;
-      key.keycode = c;
-      keystroke_pub_.publish(key);
+      if (now - last_key >= release_timeout)
+      {
+        ROS_DEBUG("RELEASE");
+        held = 0;
+        linear_ = angular_ = 0;
+        publishVelocity(origin);
+      }
+      else if (now - last_publish >= repeat_period)
+      {
+        publishVelocity(origin);
+        last_publish = now;
+      }
     }
   }
+  tcsetattr(kfd, TCSANOW, &cooked);
 }
 
 void quit(int sig)
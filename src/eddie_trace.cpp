@@ -0,0 +1,138 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_trace.h"
+#include <algorithm>
+#include <cstdio>
+
+static const char* STAGE_NAMES[] = {
+  "KEY_READ",
+  "TELEOP_PUBLISH",
+  "CONTROLLER_RECEIVE",
+  "SERVICE_CALL",
+  "DRIVER_RECEIVE",
+  "SERIAL_WRITE",
+  "SERIAL_RESPONSE",
+  "SERVICE_RETURN"
+};
+static const int STAGE_COUNT = sizeof (STAGE_NAMES) / sizeof (STAGE_NAMES[0]);
+
+EddieTrace::EddieTrace() :
+  max_traces_(10000), report_period_(5.0)
+{
+  trace_sub_ = node_handle_.subscribe("/eddie/trace", 1000, &EddieTrace::traceCallback, this);
+
+  node_handle_.param("trace_history", max_traces_, max_traces_);
+  node_handle_.param("trace_report_period", report_period_, report_period_);
+  if (report_period_ > 0)
+    report_timer_ = node_handle_.createTimer(ros::Duration(report_period_), &EddieTrace::reportCallback, this);
+}
+
+void EddieTrace::traceCallback(const parallax_eddie_robot::TraceEvent::ConstPtr& message)
+{
+  std::map<uint32_t, Trace>::iterator it = traces_.find(message->trace.id);
+  if (it == traces_.end() || it->second.origin != message->trace.origin)
+  {
+    //a restarted teleop reuses ids, the origin tells the traces apart
+    if (it == traces_.end())
+      history_.push_back(message->trace.id);
+    Trace &trace = traces_[message->trace.id];
+    trace.origin = message->trace.origin;
+    trace.stamps.clear();
+    it = traces_.find(message->trace.id);
+  }
+  it->second.stamps[message->stage] = message->stamp;
+
+  while ((int)history_.size() > max_traces_)
+  {
+    traces_.erase(history_.front());
+    history_.pop_front();
+  }
+}
+
+void EddieTrace::reportCallback(const ros::TimerEvent& event)
+{
+  report();
+}
+
+double EddieTrace::percentile(std::vector<double> &values, double p)
+{
+  if (values.empty())
+    return 0;
+  size_t n = (size_t)(p * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+void EddieTrace::report()
+{
+  std::vector<std::vector<double> > total(STAGE_COUNT), hop(STAGE_COUNT);
+  for (std::map<uint32_t, Trace>::iterator it = traces_.begin(); it != traces_.end(); ++it)
+  {
+    ros::Time previous = it->second.origin;
+    std::map<uint8_t, ros::Time>::iterator stage;
+    //stages are numbered in causal order, so the map iterates along the path
+    for (stage = it->second.stamps.begin(); stage != it->second.stamps.end(); ++stage)
+    {
+      if (stage->first >= STAGE_COUNT)
+        continue;
+      total[stage->first].push_back((stage->second - it->second.origin).toSec() * 1000);
+      hop[stage->first].push_back((stage->second - previous).toSec() * 1000);
+      previous = stage->second;
+    }
+  }
+
+  printf("\n%u traces, latencies in ms\n", (unsigned)traces_.size());
+  printf("%-20s %7s %9s %9s %9s %9s | %9s %9s\n", "stage", "count", "p50", "p90", "p99", "max", "hop p50", "hop p99");
+  for (int i = 0; i < STAGE_COUNT; i++)
+  {
+    if (total[i].empty())
+      continue;
+    double max = *std::max_element(total[i].begin(), total[i].end());
+    printf("%-20s %7u %9.3f %9.3f %9.3f %9.3f | %9.3f %9.3f\n", STAGE_NAMES[i], (unsigned)total[i].size(),
+           percentile(total[i], 0.5), percentile(total[i], 0.9), percentile(total[i], 0.99), max,
+           percentile(hop[i], 0.5), percentile(hop[i], 0.99));
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "eddie_trace");
+  EddieTrace trace;
+  ros::spin();
+  trace.report();
+
+  return 0;
+}
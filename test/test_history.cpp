@@ -0,0 +1,199 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_history.h"
+#include <gtest/gtest.h>
+#include <boost/thread.hpp>
+
+namespace
+{
+
+ros::Time at(double seconds)
+{
+  return ros::Time(seconds);
+}
+
+}
+
+TEST(EddieHistory, NeedsTwoSamples)
+{
+  EddieHistory history(8);
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  EXPECT_FALSE(history.query(at(1), 1.0, values, extrapolated));
+  history.record(at(1), 10);
+  EXPECT_FALSE(history.query(at(1), 1.0, values, extrapolated));
+  history.record(at(2), 20);
+  EXPECT_TRUE(history.query(at(1), 1.0, values, extrapolated));
+}
+
+TEST(EddieHistory, InterpolatesBetweenSamples)
+{
+  EddieHistory history(8);
+  history.record(at(1), 10, 20);
+  history.record(at(2), 20, 40);
+  history.record(at(3), 40, 0);
+
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  ASSERT_TRUE(history.query(at(1.5), 0, values, extrapolated));
+  EXPECT_NEAR(15, values[0], 1e-9);
+  EXPECT_NEAR(30, values[1], 1e-9);
+  EXPECT_FALSE(extrapolated);
+  ASSERT_TRUE(history.query(at(2.25), 0, values, extrapolated));
+  EXPECT_NEAR(25, values[0], 1e-9);
+  EXPECT_NEAR(30, values[1], 1e-9);
+  ASSERT_TRUE(history.query(at(3), 0, values, extrapolated));
+  EXPECT_NEAR(40, values[0], 1e-9);
+  EXPECT_FALSE(extrapolated);
+}
+
+TEST(EddieHistory, ExtrapolatesALimitedWay)
+{
+  EddieHistory history(8);
+  history.record(at(1), 10);
+  history.record(at(2), 20);
+
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  ASSERT_TRUE(history.query(at(2.5), 1.0, values, extrapolated));
+  EXPECT_NEAR(25, values[0], 1e-9);
+  EXPECT_TRUE(extrapolated);
+  EXPECT_FALSE(history.query(at(2.5), 0.1, values, extrapolated));
+  EXPECT_FALSE(history.query(at(0.5), 1.0, values, extrapolated));
+}
+
+TEST(EddieHistory, WrapsCircularQuantities)
+{
+  EddieHistory history(8, 360);
+  history.record(at(1), 350);
+  history.record(at(2), 10);
+
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  ASSERT_TRUE(history.query(at(1.25), 0, values, extrapolated));
+  EXPECT_NEAR(355, values[0], 1e-9);
+  ASSERT_TRUE(history.query(at(1.5), 0, values, extrapolated));
+  EXPECT_NEAR(0, values[0], 1e-9);
+  ASSERT_TRUE(history.query(at(1.75), 0, values, extrapolated));
+  EXPECT_NEAR(5, values[0], 1e-9);
+}
+
+TEST(EddieHistory, DropsSamplesOutOfOrder)
+{
+  EddieHistory history(8);
+  history.record(at(1), 10);
+  history.record(at(3), 30);
+  history.record(at(2), 100);
+  history.record(at(3), 100);
+
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  ASSERT_TRUE(history.query(at(2), 0, values, extrapolated));
+  EXPECT_NEAR(20, values[0], 1e-9);
+}
+
+TEST(EddieHistory, ForgetsSamplesPastCapacity)
+{
+  EddieHistory history(4);
+  for (int i = 1; i <= 10; i++)
+    history.record(at(i), i);
+
+  //the oldest slot is left out as the next one to be overwritten
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  EXPECT_FALSE(history.query(at(7.5), 0, values, extrapolated));
+  ASSERT_TRUE(history.query(at(8.5), 0, values, extrapolated));
+  EXPECT_NEAR(8.5, values[0], 1e-9);
+  ASSERT_TRUE(history.query(at(10), 0, values, extrapolated));
+  EXPECT_NEAR(10, values[0], 1e-9);
+}
+
+namespace
+{
+
+//Stamp of sample i, in whole nanoseconds so that the halfway point between
+//two samples is exact
+ros::Time sampleStamp(double i)
+{
+  ros::Time stamp;
+  stamp.fromNSec(1000000000ULL + (uint64_t)(i * 1000000));
+  return stamp;
+}
+
+//Records i and i * i, the second bends so that interpolating between the
+//wrong pair of samples, or a torn one, gives a wrong value
+void writeSamples(EddieHistory *history, int count, volatile int *written)
+{
+  for (int i = 1; i <= count; i++)
+  {
+    history->record(sampleStamp(i), i, (double)i * i);
+    *written = i;
+  }
+}
+
+}
+
+TEST(EddieHistory, ConcurrentReadsAreConsistent)
+{
+  const int count = 200000;
+  EddieHistory history(4);
+  volatile int written = 0;
+  boost::thread writer(boost::bind(&writeSamples, &history, count, &written));
+
+  //reads trail the writer by up to the ring's capacity, so some of them
+  //overlap the slot being overwritten
+  int found = 0;
+  double values[EddieHistory::FIELDS];
+  bool extrapolated;
+  for (int i = 0; written < count; i++)
+  {
+    double sample = written - 1 - i % 4;
+    if (!history.query(sampleStamp(sample + 0.5), 0, values, extrapolated))
+      continue;
+    found++;
+    EXPECT_NEAR(sample + 0.5, values[0], 1e-6);
+    EXPECT_NEAR(sample * sample + sample + 0.5, values[1], 1e-3);
+    if (HasFailure())
+      break;
+  }
+  writer.join();
+  EXPECT_GT(found, 0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,150 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_motor_table.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <fstream>
+
+namespace
+{
+
+EddieMotorTable measured()
+{
+  EddieMotorTable table;
+  table.add(-100, -190, -210);
+  table.add(-50, -90, -100);
+  table.add(50, 100, 80);
+  table.add(100, 200, 160);
+  return table;
+}
+
+}
+
+TEST(EddieMotorTable, EmptyTableHoldsStill)
+{
+  EddieMotorTable table;
+  EXPECT_TRUE(table.empty());
+  EXPECT_EQ(0, table.power(EddieMotorTable::LEFT, 0));
+  EXPECT_EQ(0, table.power(EddieMotorTable::LEFT, 100));
+  EXPECT_EQ(0, table.power(EddieMotorTable::RIGHT, -100));
+}
+
+TEST(EddieMotorTable, InterpolatesPowerPerWheel)
+{
+  EddieMotorTable table = measured();
+  EXPECT_FALSE(table.empty());
+  EXPECT_EQ(0, table.power(EddieMotorTable::LEFT, 0));
+  EXPECT_EQ(25, table.power(EddieMotorTable::LEFT, 50));
+  EXPECT_EQ(75, table.power(EddieMotorTable::LEFT, 150));
+  EXPECT_EQ(75, table.power(EddieMotorTable::RIGHT, 120));
+  EXPECT_EQ(100, table.power(EddieMotorTable::RIGHT, 160));
+}
+
+TEST(EddieMotorTable, ReversesWithTheSpeedSign)
+{
+  EddieMotorTable table = measured();
+  EXPECT_EQ(-25, table.power(EddieMotorTable::LEFT, -45));
+  EXPECT_EQ(-25, table.power(EddieMotorTable::RIGHT, -50));
+  EXPECT_EQ(-75, table.power(EddieMotorTable::LEFT, -140));
+}
+
+TEST(EddieMotorTable, SaturatesOutOfReach)
+{
+  EddieMotorTable table = measured();
+  EXPECT_EQ(100, table.power(EddieMotorTable::LEFT, 500));
+  EXPECT_EQ(-100, table.power(EddieMotorTable::RIGHT, -500));
+}
+
+TEST(EddieMotorTable, SkipsADipInTheCurve)
+{
+  EddieMotorTable table;
+  table.add(30, 60, 60);
+  table.add(40, 50, 50);
+  table.add(50, 100, 100);
+  //55 is passed between 0 and 30, 70 only between 40 and 50
+  EXPECT_EQ(28, table.power(EddieMotorTable::LEFT, 55));
+  EXPECT_EQ(44, table.power(EddieMotorTable::LEFT, 70));
+}
+
+TEST(EddieMotorTable, ReplacesALevel)
+{
+  EddieMotorTable table = measured();
+  size_t size = table.size();
+  table.add(50, 120, 120);
+  EXPECT_EQ(size, table.size());
+  EXPECT_EQ(50, table.power(EddieMotorTable::LEFT, 120));
+}
+
+TEST(EddieMotorTable, MaxSpeedIsTheWeakerWheel)
+{
+  EddieMotorTable table = measured();
+  EXPECT_DOUBLE_EQ(160, table.maxSpeed(100));
+  EXPECT_DOUBLE_EQ(190, table.maxSpeed(-100));
+  EXPECT_DOUBLE_EQ(0, EddieMotorTable().maxSpeed(100));
+}
+
+TEST(EddieMotorTable, SavesAndLoads)
+{
+  char path[] = "/tmp/eddie_motor_table_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  EddieMotorTable table = measured();
+  ASSERT_TRUE(table.save(path));
+  EddieMotorTable loaded;
+  ASSERT_TRUE(loaded.load(path));
+  EXPECT_EQ(table.size(), loaded.size());
+  EXPECT_EQ(75, loaded.power(EddieMotorTable::LEFT, 150));
+  EXPECT_EQ(-25, loaded.power(EddieMotorTable::LEFT, -45));
+
+  //a bad line leaves the table as it was
+  {
+    std::ofstream file(path);
+    file << "# power left right" << std::endl << "50 100 80" << std::endl << "200 300 300" << std::endl;
+  }
+  EXPECT_FALSE(loaded.load(path));
+  EXPECT_EQ(table.size(), loaded.size());
+  remove(path);
+  EXPECT_FALSE(loaded.load(path));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
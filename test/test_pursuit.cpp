@@ -0,0 +1,153 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_pursuit.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+
+std::vector<EddiePursuit::Point> polyline(const double (*points)[2], size_t count)
+{
+  std::vector<EddiePursuit::Point> path(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    path[i].x = points[i][0];
+    path[i].y = points[i][1];
+  }
+  return path;
+}
+
+const double STRAIGHT[][2] = { { 0, 0 }, { 2, 0 } };
+
+}
+
+TEST(EddiePursuit, DrivesStraightAlongALine)
+{
+  EddiePursuit pursuit;
+  pursuit.setPath(polyline(STRAIGHT, 2));
+  double linear, angular;
+  ASSERT_TRUE(pursuit.update(0, 0, 0, linear, angular));
+  EXPECT_NEAR(0.3, linear, 1e-9);
+  EXPECT_NEAR(0, angular, 1e-9);
+  EXPECT_EQ(0u, pursuit.index());
+  EXPECT_NEAR(0, pursuit.crossTrackError(), 1e-9);
+}
+
+TEST(EddiePursuit, SteersBackOntoThePath)
+{
+  EddiePursuit pursuit;
+  pursuit.setPath(polyline(STRAIGHT, 2));
+  double linear, angular;
+  ASSERT_TRUE(pursuit.update(0.5, -0.1, 0, linear, angular));
+  EXPECT_GT(linear, 0);
+  EXPECT_GT(angular, 0);
+  EXPECT_NEAR(0.1, pursuit.crossTrackError(), 1e-9);
+  ASSERT_TRUE(pursuit.update(0.5, 0.1, 0, linear, angular));
+  EXPECT_LT(angular, 0);
+}
+
+TEST(EddiePursuit, TurnsInPlaceToFaceThePath)
+{
+  EddiePursuit pursuit;
+  pursuit.setLimits(1.5, 0.2, 0.3);
+  pursuit.setPath(polyline(STRAIGHT, 2));
+  double linear, angular;
+  //the lookahead point is behind the robot, to its right and then its left
+  ASSERT_TRUE(pursuit.update(0, 0, 3 * M_PI / 4, linear, angular));
+  EXPECT_EQ(0, linear);
+  EXPECT_DOUBLE_EQ(-1.5, angular);
+  ASSERT_TRUE(pursuit.update(0, 0, -3 * M_PI / 4, linear, angular));
+  EXPECT_EQ(0, linear);
+  EXPECT_DOUBLE_EQ(1.5, angular);
+}
+
+TEST(EddiePursuit, SlowsDownToStop)
+{
+  EddiePursuit pursuit;
+  pursuit.setPath(polyline(STRAIGHT, 2));
+  double linear, angular;
+  ASSERT_TRUE(pursuit.update(1.9, 0, 0, linear, angular));
+  EXPECT_NEAR(sqrt(2 * 0.3 * 0.1), linear, 1e-9);
+  EXPECT_FALSE(pursuit.update(1.98, 0, 0, linear, angular));
+  EXPECT_EQ(0, linear);
+  EXPECT_EQ(0, angular);
+  EXPECT_NEAR(0.99, pursuit.progress(), 1e-9);
+}
+
+TEST(EddiePursuit, FollowsACrossingPathInOrder)
+{
+  //the last segment crosses the first at (1, 0)
+  const double points[][2] = { { 0, 0 }, { 2, 0 }, { 2, 1 }, { 1, 1 }, { 1, -1 } };
+  EddiePursuit pursuit;
+  pursuit.setPath(polyline(points, 5));
+  double linear, angular;
+  ASSERT_TRUE(pursuit.update(0, 0, 0, linear, angular));
+  ASSERT_TRUE(pursuit.update(1, 0, 0, linear, angular));
+  EXPECT_EQ(0u, pursuit.index());
+  EXPECT_NEAR(1.0 / 6, pursuit.progress(), 1e-9);
+}
+
+TEST(EddiePursuit, CompletesACorner)
+{
+  const double points[][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 } };
+  EddiePursuit pursuit;
+  pursuit.setPath(polyline(points, 3));
+
+  //drive a unicycle along at the commanded velocities
+  double x = 0, y = 0, theta = 0, linear, angular, worst = 0;
+  const double dt = 0.02;
+  int steps = 0;
+  while (pursuit.update(x, y, theta, linear, angular) && steps < 2000)
+  {
+    worst = std::max(worst, pursuit.crossTrackError());
+    x += linear * cos(theta) * dt;
+    y += linear * sin(theta) * dt;
+    theta += angular * dt;
+    steps++;
+  }
+  EXPECT_LT(steps, 2000);
+  EXPECT_NEAR(1, x, 0.05);
+  EXPECT_NEAR(1, y, 0.05);
+  EXPECT_LT(worst, 0.15);
+  EXPECT_EQ(1u, pursuit.index());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
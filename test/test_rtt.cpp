@@ -0,0 +1,106 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_rtt.h"
+#include <gtest/gtest.h>
+
+TEST(EddieRTT, InitialTimeoutBeforeFirstSample)
+{
+  EddieRTT rtt;
+  rtt.setLimits(0.1, 0.01, 0.5);
+  EXPECT_DOUBLE_EQ(0.1, rtt.timeout(0));
+  EXPECT_DOUBLE_EQ(0.1, rtt.smoothed());
+}
+
+TEST(EddieRTT, FirstSamplePrimesTheEstimate)
+{
+  EddieRTT rtt;
+  rtt.setLimits(0.1, 0.01, 0.5);
+  rtt.update(0.02);
+  //srtt = rtt and rttvar = rtt / 2, so the timeout is three round trips
+  EXPECT_DOUBLE_EQ(0.02, rtt.smoothed());
+  EXPECT_NEAR(0.06, rtt.timeout(0), 1e-9);
+}
+
+TEST(EddieRTT, SteadySamplesTightenTheTimeout)
+{
+  EddieRTT rtt;
+  rtt.setLimits(0.1, 0.01, 0.5);
+  for (int i = 0; i < 100; i++)
+    rtt.update(0.02);
+  EXPECT_NEAR(0.02, rtt.smoothed(), 1e-9);
+  EXPECT_NEAR(0.02, rtt.timeout(0), 1e-6);
+}
+
+TEST(EddieRTT, JitterWidensTheTimeout)
+{
+  EddieRTT steady, jittery;
+  for (int i = 0; i < 100; i++)
+  {
+    steady.update(0.02);
+    jittery.update(i % 2 ? 0.01 : 0.03);
+  }
+  EXPECT_NEAR(0.02, jittery.smoothed(), 0.005);
+  EXPECT_GT(jittery.timeout(0), steady.timeout(0) + 0.02);
+}
+
+TEST(EddieRTT, TimeoutIsClamped)
+{
+  EddieRTT slow, fast;
+  slow.setLimits(0.1, 0.01, 0.5);
+  fast.setLimits(0.1, 0.01, 0.5);
+  slow.update(1.0);
+  fast.update(0.001);
+  EXPECT_DOUBLE_EQ(0.5, slow.timeout(0));
+  EXPECT_DOUBLE_EQ(0.01, fast.timeout(0));
+}
+
+TEST(EddieRTT, RetriesBackOff)
+{
+  EddieRTT rtt;
+  rtt.setLimits(0.1, 0.01, 0.5);
+  rtt.update(0.02);
+  EXPECT_NEAR(0.06, rtt.timeout(0), 1e-9);
+  EXPECT_NEAR(0.12, rtt.timeout(1), 1e-9);
+  EXPECT_NEAR(0.24, rtt.timeout(2), 1e-9);
+  EXPECT_NEAR(0.48, rtt.timeout(3), 1e-9);
+  EXPECT_DOUBLE_EQ(0.5, rtt.timeout(4));
+  EXPECT_DOUBLE_EQ(0.5, rtt.timeout(100));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,219 @@
+/*
+ * Software License Agreement (BSD License)
+ *
+ * Copyright (c) 2012, Haikal Pribadi <haikal.pribadi@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of the Haikal Pribadi nor the names of other
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eddie_telemetry.h"
+#include <gtest/gtest.h>
+#include <limits>
+
+using eddie_telemetry::Frame;
+
+namespace
+{
+
+ros::Time stamp(uint64_t usec)
+{
+  ros::Time time;
+  time.fromNSec(1000000000000ULL + usec * 1000);
+  return time;
+}
+
+//A full frame for cycle i with slowly changing values
+Frame frameAt(int i)
+{
+  Frame frame;
+  frame.stamp = stamp(i * 20000);
+  frame.has_ping = true;
+  frame.ping_stamp = stamp(i * 20000 - 3000);
+  for (int j = 0; j < 4; j++)
+    frame.ping.push_back(300 + j * 10 + i % 3);
+  frame.has_adc = true;
+  frame.adc_stamp = stamp(i * 20000 - 2000);
+  for (int j = 0; j < 8; j++)
+    frame.adc.push_back(1000 + j + i);
+  frame.has_encoders = true;
+  frame.encoder_stamp = stamp(i * 20000 - 1000);
+  frame.left_ticks = 5 * i;
+  frame.right_ticks = -6 * i;
+  frame.has_heading = true;
+  frame.heading_stamp = stamp(i * 20000 - 500);
+  frame.heading = (350 + i) % 360;
+  return frame;
+}
+
+void expectEqual(const Frame &expected, const Frame &actual)
+{
+  EXPECT_TRUE(expected.stamp == actual.stamp);
+  ASSERT_EQ(expected.has_ping, actual.has_ping);
+  if (expected.has_ping)
+  {
+    EXPECT_TRUE(expected.ping_stamp == actual.ping_stamp);
+    EXPECT_EQ(expected.ping, actual.ping);
+  }
+  ASSERT_EQ(expected.has_adc, actual.has_adc);
+  if (expected.has_adc)
+  {
+    EXPECT_TRUE(expected.adc_stamp == actual.adc_stamp);
+    EXPECT_EQ(expected.adc, actual.adc);
+  }
+  ASSERT_EQ(expected.has_encoders, actual.has_encoders);
+  if (expected.has_encoders)
+  {
+    EXPECT_TRUE(expected.encoder_stamp == actual.encoder_stamp);
+    EXPECT_EQ(expected.left_ticks, actual.left_ticks);
+    EXPECT_EQ(expected.right_ticks, actual.right_ticks);
+  }
+  ASSERT_EQ(expected.has_heading, actual.has_heading);
+  if (expected.has_heading)
+  {
+    EXPECT_TRUE(expected.heading_stamp == actual.heading_stamp);
+    EXPECT_EQ(expected.heading, actual.heading);
+  }
+}
+
+}
+
+TEST(EddieTelemetry, RoundTripsFrames)
+{
+  eddie_telemetry::Encoder encoder(5);
+  eddie_telemetry::Decoder decoder;
+  for (int i = 1; i <= 20; i++)
+  {
+    parallax_eddie_robot::CompactTelemetry message;
+    encoder.encode(frameAt(i), message);
+    EXPECT_EQ((uint32_t)i - 1, message.sequence);
+    EXPECT_EQ((i - 1) % 5 == 0, (bool)(message.flags & parallax_eddie_robot::CompactTelemetry::KEYFRAME));
+    Frame frame;
+    ASSERT_TRUE(decoder.decode(message, frame));
+    expectEqual(frameAt(i), frame);
+  }
+  EXPECT_EQ(0u, decoder.lost());
+}
+
+TEST(EddieTelemetry, DeltaFramesAreSmaller)
+{
+  eddie_telemetry::Encoder encoder(10);
+  parallax_eddie_robot::CompactTelemetry keyframe, delta;
+  encoder.encode(frameAt(1), keyframe);
+  encoder.encode(frameAt(2), delta);
+  EXPECT_LT(delta.data.size(), keyframe.data.size());
+}
+
+TEST(EddieTelemetry, RoundTripsPartialFrames)
+{
+  eddie_telemetry::Encoder encoder(10);
+  eddie_telemetry::Decoder decoder;
+  for (int i = 1; i <= 16; i++)
+  {
+    Frame sent = frameAt(i);
+    sent.has_ping = i & 1;
+    sent.has_adc = i & 2;
+    sent.has_encoders = i & 4;
+    sent.has_heading = i & 8;
+    if (!sent.has_ping)
+      sent.ping.clear();
+    if (!sent.has_adc)
+      sent.adc.clear();
+    parallax_eddie_robot::CompactTelemetry message;
+    encoder.encode(sent, message);
+    Frame frame;
+    ASSERT_TRUE(decoder.decode(message, frame));
+    expectEqual(sent, frame);
+  }
+}
+
+TEST(EddieTelemetry, RoundTripsExtremeValues)
+{
+  eddie_telemetry::Encoder encoder(10);
+  eddie_telemetry::Decoder decoder;
+  const int32_t low = std::numeric_limits<int32_t>::min(), high = std::numeric_limits<int32_t>::max();
+  const int32_t ticks[] = { low, high, 0, low, -1 };
+  const uint16_t headings[] = { 0, 359, 180, 1, 359 };
+  for (int i = 0; i < 5; i++)
+  {
+    Frame sent = frameAt(i + 1);
+    sent.left_ticks = ticks[i];
+    sent.right_ticks = ticks[4 - i];
+    sent.heading = headings[i];
+    sent.ping[0] = i % 2 ? 65535 : 0;
+    parallax_eddie_robot::CompactTelemetry message;
+    encoder.encode(sent, message);
+    Frame frame;
+    ASSERT_TRUE(decoder.decode(message, frame));
+    expectEqual(sent, frame);
+  }
+}
+
+TEST(EddieTelemetry, ResynchronizesOnAKeyframe)
+{
+  eddie_telemetry::Encoder encoder(4);
+  eddie_telemetry::Decoder decoder;
+  std::vector<parallax_eddie_robot::CompactTelemetry> messages(12);
+  for (int i = 0; i < 12; i++)
+    encoder.encode(frameAt(i + 1), messages[i]);
+
+  //joining mid-stream waits for the keyframe at 4
+  Frame frame;
+  EXPECT_FALSE(decoder.decode(messages[2], frame));
+  EXPECT_FALSE(decoder.decode(messages[3], frame));
+  ASSERT_TRUE(decoder.decode(messages[4], frame));
+  expectEqual(frameAt(5), frame);
+  ASSERT_TRUE(decoder.decode(messages[5], frame));
+
+  //losing 6 makes 7 undecodable, the keyframe at 8 picks up again
+  EXPECT_FALSE(decoder.decode(messages[7], frame));
+  EXPECT_EQ(1u, decoder.lost());
+  ASSERT_TRUE(decoder.decode(messages[8], frame));
+  expectEqual(frameAt(9), frame);
+  ASSERT_TRUE(decoder.decode(messages[9], frame));
+  expectEqual(frameAt(10), frame);
+}
+
+TEST(EddieTelemetry, RejectsTruncatedFrames)
+{
+  eddie_telemetry::Encoder encoder(4);
+  eddie_telemetry::Decoder decoder;
+  parallax_eddie_robot::CompactTelemetry first, second;
+  encoder.encode(frameAt(1), first);
+  encoder.encode(frameAt(2), second);
+  first.data.resize(first.data.size() / 2);
+  Frame frame;
+  EXPECT_FALSE(decoder.decode(first, frame));
+  EXPECT_FALSE(decoder.decode(second, frame));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}